@@ -9,6 +9,7 @@
 #include "devices/timer.h"
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "lib/kernel/hash.h"
 #include "lib/kernel/list.h"
 #include "threads/flags.h"
@@ -24,6 +25,8 @@
 #define CACHE_SIZE 64
 #define WRITE_BEHIND_PERIOD 15 // Timer ticks between each write-behind
 #define WRITE_BEHIND_PRIORITY PRI_DEFAULT // Priority of write-behind thread
+#define READ_AHEAD_QUEUE_LEN 32 // Sectors waiting to be read ahead
+#define READ_AHEAD_PRIORITY PRI_DEFAULT // Priority of read-ahead thread
 
 struct cache_entry {  // Can be anything, form meta data to actual data
   block_sector_t sector;
@@ -37,9 +40,17 @@ struct cache_entry {  // Can be anything, form meta data to actual data
 static struct cache_entry buffer_cache[CACHE_SIZE];
 static struct lock buffer_lock;  // Global cache lock
 
+// Ring buffer of sectors for the read-ahead thread to bring in
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_LEN];
+static int read_ahead_head;  // Index of the oldest queued sector
+static int read_ahead_cnt;   // Number of queued sectors
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready;
+
 static void allocate_cache(void);
 static struct cache_entry *next_cache_entry(void);
 static thread_func write_behind;
+static thread_func read_ahead;
 
 static struct cache_entry *next_cache_entry() {
   lock_acquire(&buffer_lock);
@@ -68,7 +79,10 @@ static struct cache_entry *next_cache_entry() {
 }
 
 
-static struct cache_entry *find_cache_entry(block_sector_t sector) {
+// Returns the cache entry for SECTOR with its block_lock held, bringing
+// the sector in if needed. A sector brought in is read from disk only if
+// LOAD, since callers about to overwrite all of it do not need it.
+static struct cache_entry *find_cache_entry(block_sector_t sector, bool load) {
   lock_acquire(&buffer_lock);
   struct cache_entry *cache_e = NULL;
 
@@ -81,10 +95,29 @@ static struct cache_entry *find_cache_entry(block_sector_t sector) {
   lock_release(&buffer_lock);
 
   if (cache_e == NULL) {
-    cache_e = next_cache_entry();
-    cache_e->sector = sector;
-    block_read(fs_device, sector, cache_e->data);
-    return cache_e;
+    struct cache_entry *victim = next_cache_entry();
+    // Another thread, such as read-ahead, may have brought SECTOR in
+    // while the victim was written back; look again before taking the
+    // victim, and claim it under buffer_lock so that only one entry ever
+    // holds a sector. Lookups that find the claimed entry wait on its
+    // block_lock until it is loaded.
+    lock_acquire(&buffer_lock);
+    for (int i = 0; i < CACHE_SIZE; i++) {
+      if (buffer_cache[i].sector == sector) {
+        cache_e = &buffer_cache[i];
+        break;
+      }
+    }
+    if (cache_e == NULL || cache_e == victim) {
+      victim->sector = sector;
+      lock_release(&buffer_lock);
+      if (load && cache_e == NULL) {
+        block_read(fs_device, sector, victim->data);
+      }
+      return victim;
+    }
+    lock_release(&buffer_lock);
+    lock_release(&victim->block_lock);
   }
   lock_acquire(&cache_e->block_lock);
   if (cache_e->sector == sector) {
@@ -92,7 +125,7 @@ static struct cache_entry *find_cache_entry(block_sector_t sector) {
   }
   lock_release(&cache_e->block_lock);
 
-  return find_cache_entry(sector);
+  return find_cache_entry(sector, load);
 }
 
 static void allocate_cache(void) {
@@ -107,8 +140,11 @@ static void allocate_cache(void) {
 
 void cache_init(void) {
   lock_init(&buffer_lock);
+  lock_init(&read_ahead_lock);
+  cond_init(&read_ahead_ready);
   allocate_cache();
   thread_create("write-behind", WRITE_BEHIND_PRIORITY, write_behind, NULL);
+  thread_create("read-ahead", READ_AHEAD_PRIORITY, read_ahead, NULL);
 }
 
 void cache_write(block_sector_t sector, const void *buffer, int size,
@@ -118,7 +154,8 @@ void cache_write(block_sector_t sector, const void *buffer, int size,
   ASSERT(offset + size <= BLOCK_SECTOR_SIZE);
 
   // Will either get the cached block or place the block in cache
-  struct cache_entry *cache_e = find_cache_entry(sector);
+  struct cache_entry *cache_e =
+      find_cache_entry(sector, size < BLOCK_SECTOR_SIZE);
   // Don't write to block until eviction!!!!
 
   cache_e->dirty = true;
@@ -132,7 +169,7 @@ void cache_read(block_sector_t sector, void *buffer, int size, int offset) {
   ASSERT(offset >= 0);
   ASSERT(offset + size <= BLOCK_SECTOR_SIZE);
 
-  struct cache_entry *cache_e = find_cache_entry(sector);
+  struct cache_entry *cache_e = find_cache_entry(sector, true);
   cache_e->accessed = true;
   memcpy(buffer, cache_e->data + offset, size);
   lock_release(&cache_e->block_lock);
@@ -152,12 +189,43 @@ void cache_save(void) {
 void write_behind(void *aux UNUSED) {
   while (true) {
     timer_sleep(WRITE_BEHIND_PERIOD);
+    inode_flush_delayed();  // Delayed sectors get their places on disk here
     cache_save();
   }
 }
 
+// Queues SECTOR to be brought into the cache by the read-ahead thread and
+// returns without waiting for it. Requests are dropped if the queue is full.
+void cache_prefetch(block_sector_t sector) {
+  lock_acquire(&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_QUEUE_LEN) {
+    int tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_QUEUE_LEN;
+    read_ahead_queue[tail] = sector;
+    read_ahead_cnt++;
+    cond_signal(&read_ahead_ready, &read_ahead_lock);
+  }
+  lock_release(&read_ahead_lock);
+}
+
+void read_ahead(void *aux UNUSED) {
+  while (true) {
+    lock_acquire(&read_ahead_lock);
+    while (read_ahead_cnt == 0) {
+      cond_wait(&read_ahead_ready, &read_ahead_lock);
+    }
+    block_sector_t sector = read_ahead_queue[read_ahead_head];
+    read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_LEN;
+    read_ahead_cnt--;
+    lock_release(&read_ahead_lock);
+
+    // Left unaccessed so that an unused prefetch is the first to go
+    struct cache_entry *cache_e = find_cache_entry(sector, true);
+    lock_release(&cache_e->block_lock);
+  }
+}
+
 void cache_zero(block_sector_t sector){
-  struct cache_entry *cache_e = find_cache_entry(sector);
+  struct cache_entry *cache_e = find_cache_entry(sector, false);
   memset(cache_e->data, 0, BLOCK_SECTOR_SIZE);
   cache_e->dirty = true;
   cache_e->accessed = true;
@@ -12,5 +12,6 @@ cache_write(block_sector_t sector, const void *buffer, int size, int offset);
 void cache_read(block_sector_t sector, void *buffer, int size, int offset);
 void cache_save(void);
 void cache_zero(block_sector_t sector);
+void cache_prefetch(block_sector_t sector);
 
 #endif /* filesys/cache.h */
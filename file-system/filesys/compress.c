@@ -0,0 +1,119 @@
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "filesys/compress.h"
+#include "threads/malloc.h"
+
+// A small LZ77 codec for compressed files. The compressed stream is a
+// sequence of tokens, each starting with a control byte C:
+//   C < 0x80:  C + 1 literal bytes follow.
+//   C >= 0x80: copy (C & 0x7f) + MIN_MATCH bytes from OFFSET bytes back
+//              in the output, where OFFSET is the next two bytes, low
+//              byte first.
+#define MIN_MATCH 3
+#define MAX_MATCH (0x7f + MIN_MATCH)
+#define MAX_LITERALS 0x80
+#define MAX_OFFSET 0xffff
+#define HASH_BITS 10
+#define NO_POS 0xffff
+
+static unsigned hash3(const uint8_t *p) {
+  return ((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & ((1 << HASH_BITS) - 1);
+}
+
+// Emits SRC[START, END) as literal tokens at DST + *OUT. Returns false if
+// they do not fit in CAP bytes.
+static bool put_literals(const uint8_t *src, size_t start, size_t end,
+                         uint8_t *dst, size_t *out, size_t cap) {
+  while (start < end) {
+    size_t cnt = end - start < MAX_LITERALS ? end - start : MAX_LITERALS;
+    if (*out + 1 + cnt > cap) {
+      return false;
+    }
+    dst[(*out)++] = cnt - 1;
+    memcpy(dst + *out, src + start, cnt);
+    *out += cnt;
+    start += cnt;
+  }
+  return true;
+}
+
+// Compresses the SIZE bytes at SRC into DST, which has room for CAP bytes.
+// Returns the compressed size, or 0 if it would not fit in CAP or memory
+// ran out, in which case the data is best stored as is.
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t cap) {
+  ASSERT(size < NO_POS);
+  uint16_t *table = malloc(sizeof *table << HASH_BITS);
+  if (table == NULL) {
+    return 0;
+  }
+  memset(table, 0xff, sizeof *table << HASH_BITS);
+
+  size_t in = 0, out = 0, literals = 0;
+  bool fits = true;
+  while (fits && in + MIN_MATCH <= size) {
+    unsigned h = hash3(src + in);
+    size_t cand = table[h];
+    table[h] = in;
+
+    size_t len = 0;
+    if (cand != NO_POS && in - cand <= MAX_OFFSET) {
+      while (in + len < size && len < MAX_MATCH
+             && src[cand + len] == src[in + len]) {
+        len++;
+      }
+    }
+    if (len < MIN_MATCH) {
+      in++;
+      continue;
+    }
+
+    fits = put_literals(src, literals, in, dst, &out, cap) && out + 3 <= cap;
+    if (fits) {
+      dst[out++] = 0x80 | (len - MIN_MATCH);
+      dst[out++] = (in - cand) & 0xff;
+      dst[out++] = (in - cand) >> 8;
+      in += len;
+      literals = in;
+    }
+  }
+  fits = fits && put_literals(src, literals, size, dst, &out, cap);
+  free(table);
+  return fits ? out : 0;
+}
+
+// Decompresses the SIZE bytes at SRC into DST, which has room for CAP
+// bytes. Returns the number of bytes produced, stopping early at anything
+// malformed.
+size_t lz_decompress(const uint8_t *src, size_t size, uint8_t *dst,
+                     size_t cap) {
+  size_t in = 0, out = 0;
+  while (in < size) {
+    uint8_t c = src[in++];
+    if (c < MAX_LITERALS) {
+      size_t cnt = c + 1;
+      if (in + cnt > size || out + cnt > cap) {
+        break;
+      }
+      memcpy(dst + out, src + in, cnt);
+      in += cnt;
+      out += cnt;
+    } else {
+      size_t len = (c & 0x7f) + MIN_MATCH;
+      if (in + 2 > size) {
+        break;
+      }
+      size_t offset = src[in] | (src[in + 1] << 8);
+      in += 2;
+      if (offset == 0 || offset > out || out + len > cap) {
+        break;
+      }
+      // Byte by byte, since the source may overlap what is being written
+      for (size_t i = 0; i < len; i++, out++) {
+        dst[out] = dst[out - offset];
+      }
+    }
+  }
+  return out;
+}
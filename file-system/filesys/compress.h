@@ -0,0 +1,11 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t cap);
+size_t lz_decompress(const uint8_t *src, size_t size, uint8_t *dst,
+                     size_t cap);
+
+#endif /* filesys/compress.h */
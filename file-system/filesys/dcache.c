@@ -0,0 +1,146 @@
+#include <debug.h>
+#include <string.h>
+
+#include "filesys/dcache.h"
+#include "filesys/directory.h"
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+#define DCACHE_SIZE 256 // Most names remembered at once
+
+// Remembers what a name in a directory resolved to. A negative entry,
+// for a name that does not exist, has an inode_sector of 0, which no
+// directory entry can refer to since it holds the free map's inode.
+struct dentry {
+  struct hash_elem hash_elem;
+  struct list_elem lru_elem;   // Position in dcache_lru
+  block_sector_t dir_sector;   // Inode sector of the directory
+  char name[NAME_MAX + 1];     // Name within that directory
+  block_sector_t inode_sector; // What NAME resolves to, or 0 if nothing
+};
+
+static struct hash dcache;
+static struct list dcache_lru;  // Front is most recently used
+static struct lock dcache_lock;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find_dentry(block_sector_t dir, const char *name);
+static void remove_dentry(struct dentry *d);
+
+static unsigned dentry_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct dentry *d = hash_entry(e, struct dentry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->dir_sector);
+}
+
+static bool dentry_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                        void *aux UNUSED) {
+  const struct dentry *a = hash_entry(a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry(b_, struct dentry, hash_elem);
+  if (a->dir_sector != b->dir_sector) {
+    return a->dir_sector < b->dir_sector;
+  }
+  return strcmp(a->name, b->name) < 0;
+}
+
+static struct dentry *find_dentry(block_sector_t dir, const char *name) {
+  ASSERT(lock_held_by_current_thread(&dcache_lock));
+  struct dentry key;
+  key.dir_sector = dir;
+  strlcpy(key.name, name, sizeof key.name);
+  struct hash_elem *e = hash_find(&dcache, &key.hash_elem);
+  return e == NULL ? NULL : hash_entry(e, struct dentry, hash_elem);
+}
+
+static void remove_dentry(struct dentry *d) {
+  ASSERT(lock_held_by_current_thread(&dcache_lock));
+  hash_delete(&dcache, &d->hash_elem);
+  list_remove(&d->lru_elem);
+  free(d);
+}
+
+void dcache_init(void) {
+  hash_init(&dcache, dentry_hash, dentry_less, NULL);
+  list_init(&dcache_lru);
+  lock_init(&dcache_lock);
+}
+
+// Looks up NAME in the directory whose inode is in sector DIR. Returns
+// false if the cache does not know. Otherwise stores the sector NAME
+// resolves to in *SECTORP, or 0 if it is known not to exist.
+bool dcache_lookup(block_sector_t dir, const char *name,
+                   block_sector_t *sectorp) {
+  if (strlen(name) > NAME_MAX) {
+    return false;
+  }
+  lock_acquire(&dcache_lock);
+  struct dentry *d = find_dentry(dir, name);
+  if (d != NULL) {
+    *sectorp = d->inode_sector;
+    list_remove(&d->lru_elem);
+    list_push_front(&dcache_lru, &d->lru_elem);
+  }
+  lock_release(&dcache_lock);
+  return d != NULL;
+}
+
+// Records that NAME in directory DIR resolves to SECTOR, or to nothing
+// if SECTOR is 0. Must be called with DIR locked, so that the entry
+// cannot race with a change to the directory.
+void dcache_insert(block_sector_t dir, const char *name,
+                   block_sector_t sector) {
+  if (strlen(name) > NAME_MAX) {
+    return;
+  }
+  lock_acquire(&dcache_lock);
+  struct dentry *d = find_dentry(dir, name);
+  if (d == NULL) {
+    if (hash_size(&dcache) >= DCACHE_SIZE) {
+      remove_dentry(list_entry(list_back(&dcache_lru), struct dentry,
+                               lru_elem));
+    }
+    d = malloc(sizeof *d);
+    if (d == NULL) {
+      lock_release(&dcache_lock);
+      return;
+    }
+    d->dir_sector = dir;
+    strlcpy(d->name, name, sizeof d->name);
+    hash_insert(&dcache, &d->hash_elem);
+  } else {
+    list_remove(&d->lru_elem);
+  }
+  d->inode_sector = sector;
+  list_push_front(&dcache_lru, &d->lru_elem);
+  lock_release(&dcache_lock);
+}
+
+// Forgets NAME in directory DIR.
+void dcache_invalidate(block_sector_t dir, const char *name) {
+  if (strlen(name) > NAME_MAX) {
+    return;
+  }
+  lock_acquire(&dcache_lock);
+  struct dentry *d = find_dentry(dir, name);
+  if (d != NULL) {
+    remove_dentry(d);
+  }
+  lock_release(&dcache_lock);
+}
+
+// Forgets every name in directory DIR, which is being removed and whose
+// sector may be reused.
+void dcache_invalidate_dir(block_sector_t dir) {
+  lock_acquire(&dcache_lock);
+  struct list_elem *e = list_begin(&dcache_lru);
+  while (e != list_end(&dcache_lru)) {
+    struct dentry *d = list_entry(e, struct dentry, lru_elem);
+    e = list_next(e);
+    if (d->dir_sector == dir) {
+      remove_dentry(d);
+    }
+  }
+  lock_release(&dcache_lock);
+}
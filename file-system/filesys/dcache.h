@@ -0,0 +1,14 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t dir, const char *name,
+                   block_sector_t *sectorp);
+void dcache_insert(block_sector_t dir, const char *name, block_sector_t sector);
+void dcache_invalidate(block_sector_t dir, const char *name);
+void dcache_invalidate_dir(block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -0,0 +1,40 @@
+#include <debug.h>
+#include <round.h>
+
+#include "devices/timer.h"
+#include "filesys/defrag.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/thread.h"
+
+#define DEFRAG_PERIOD 1000 // Timer ticks between passes over open inodes
+#define DEFRAG_PRIORITY PRI_MIN // Priority of the defragmenter thread
+#define DEFRAG_MAX_SECTORS 512 // Larger files are left where they are
+#define DEFRAG_SECTORS_PER_TICK 8 // Most sectors moved per tick, on average
+
+static thread_func defrag;
+
+// Starts the defragmenter thread.
+void defrag_init(void) {
+  thread_create("defrag", DEFRAG_PRIORITY, defrag, NULL);
+}
+
+// Every DEFRAG_PERIOD ticks, walks the open files and moves the blocks
+// of each fragmented one into a contiguous run. After moving a file it
+// sleeps long enough to keep under DEFRAG_SECTORS_PER_TICK, so that
+// foreground I/O is not starved of the disk.
+static void defrag(void *aux UNUSED) {
+  while (true) {
+    timer_sleep(DEFRAG_PERIOD);
+    block_sector_t sector = FREE_MAP_SECTOR;
+    struct inode *inode;
+    while ((inode = inode_open_next(sector)) != NULL) {
+      sector = inode_get_inumber(inode);
+      int moved = inode_defragment(inode, DEFRAG_MAX_SECTORS);
+      inode_close(inode);
+      if (moved > 0) {
+        timer_sleep(DIV_ROUND_UP(moved, DEFRAG_SECTORS_PER_TICK));
+      }
+    }
+  }
+}
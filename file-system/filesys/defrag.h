@@ -0,0 +1,6 @@
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+void defrag_init(void);
+
+#endif /* filesys/defrag.h */
@@ -0,0 +1,557 @@
+#include "filesys/directory.h"
+#include <stdio.h>
+#include <string.h>
+#include <hash.h>
+#include "filesys/dcache.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+
+/* A directory. */
+struct dir
+  {
+    struct inode *inode;                /* Backing store. */
+    off_t pos;                          /* Current entry slot. */
+  };
+
+/* A single directory entry. */
+struct dir_entry
+  {
+    block_sector_t inode_sector;        /* Sector number of header. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    bool in_use;                        /* In use or free? */
+  };
+
+/* Directories are hash tables of entries.  The first sector of a
+   directory holds its dir_header, and bucket I fills sector I + 1.
+   A name hashes to a bucket and lives there or, if that bucket was
+   full when the name was added, in one of the buckets after it.
+
+   An entry whose inode_sector is 0 has never been used, and ends a
+   search.  A removed entry keeps its inode_sector so that searches
+   carry on past it until the table is next rebuilt. */
+#define DIR_BUCKET_LEN (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+#define DIR_BUCKET_SIZE (DIR_BUCKET_LEN * sizeof (struct dir_entry))
+
+/* Header in the first sector of every directory. */
+struct dir_header
+  {
+    block_sector_t parent;              /* Inode sector of "..". */
+    uint32_t bucket_cnt;                /* Number of buckets, a power of 2. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t used_cnt;                  /* Entries in use or removed. */
+  };
+
+/* Returns the byte offset of bucket BUCKET in a directory. */
+static off_t
+bucket_ofs (uint32_t bucket)
+{
+  return (off_t) (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket where a search for NAME starts. */
+static uint32_t
+name_bucket (const struct dir_header *hdr, const char *name)
+{
+  return hash_string (name) & (hdr->bucket_cnt - 1);
+}
+
+static bool
+read_header (struct inode *inode, struct dir_header *hdr)
+{
+  return inode_read_at (inode, hdr, sizeof *hdr, 0) == sizeof *hdr;
+}
+
+static bool
+write_header (struct inode *inode, const struct dir_header *hdr)
+{
+  return inode_write_at (inode, hdr, sizeof *hdr, 0) == sizeof *hdr;
+}
+
+/* Searches the directory in INODE for an entry named NAME, using
+   BUCKET as space for one bucket.  On success, copies the entry
+   into *EP and its byte offset into *OFSP, if they are nonnull,
+   and returns true. */
+static bool
+lookup (struct inode *inode, const struct dir_header *hdr, const char *name,
+        struct dir_entry *bucket, struct dir_entry *ep, off_t *ofsp)
+{
+  uint32_t start = name_bucket (hdr, name);
+  for (uint32_t i = 0; i < hdr->bucket_cnt; i++)
+    {
+      uint32_t b = (start + i) & (hdr->bucket_cnt - 1);
+      if (inode_read_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b))
+          != DIR_BUCKET_SIZE)
+        return false;
+
+      bool ended = false;
+      for (size_t j = 0; j < DIR_BUCKET_LEN; j++)
+        {
+          if (bucket[j].in_use && !strcmp (name, bucket[j].name))
+            {
+              if (ep != NULL)
+                *ep = bucket[j];
+              if (ofsp != NULL)
+                *ofsp = bucket_ofs (b) + j * sizeof *bucket;
+              return true;
+            }
+          if (bucket[j].inode_sector == 0)
+            ended = true;
+        }
+      if (ended)
+        break;
+    }
+  return false;
+}
+
+/* Stores E in the first free slot on its search path in the
+   directory in INODE, using BUCKET as space for one bucket.
+   Returns true if successful, false on failure. */
+static bool
+place (struct inode *inode, struct dir_header *hdr,
+       const struct dir_entry *e, struct dir_entry *bucket)
+{
+  uint32_t start = name_bucket (hdr, e->name);
+  for (uint32_t i = 0; i < hdr->bucket_cnt; i++)
+    {
+      uint32_t b = (start + i) & (hdr->bucket_cnt - 1);
+      if (inode_read_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b))
+          != DIR_BUCKET_SIZE)
+        return false;
+
+      for (size_t j = 0; j < DIR_BUCKET_LEN; j++)
+        if (!bucket[j].in_use)
+          {
+            if (bucket[j].inode_sector == 0)
+              hdr->used_cnt++;
+            off_t ofs = bucket_ofs (b) + j * sizeof *e;
+            return inode_write_at (inode, e, sizeof *e, ofs) == sizeof *e;
+          }
+    }
+  return false;
+}
+
+/* Rebuilds the hash table of the directory in INODE with BUCKET_CNT
+   buckets, dropping removed entries, using BUCKET as space for one
+   bucket.  Returns true if successful, false on failure. */
+static bool
+rehash (struct inode *inode, struct dir_header *hdr, uint32_t bucket_cnt,
+        struct dir_entry *bucket)
+{
+  struct dir_entry *entries = NULL;
+  size_t cnt = 0;
+  bool success = false;
+
+  if (hdr->entry_cnt > 0)
+    {
+      entries = malloc (hdr->entry_cnt * sizeof *entries);
+      if (entries == NULL)
+        return false;
+    }
+  for (uint32_t b = 0; b < hdr->bucket_cnt; b++)
+    {
+      if (inode_read_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b))
+          != DIR_BUCKET_SIZE)
+        goto done;
+      for (size_t j = 0; j < DIR_BUCKET_LEN && cnt < hdr->entry_cnt; j++)
+        if (bucket[j].in_use)
+          entries[cnt++] = bucket[j];
+    }
+
+  /* Grow the directory to its new size first, so that running out of
+     disk space leaves the old table intact. */
+  memset (bucket, 0, DIR_BUCKET_SIZE);
+  if (inode_write_at (inode, bucket, DIR_BUCKET_SIZE,
+                      bucket_ofs (bucket_cnt - 1)) != DIR_BUCKET_SIZE)
+    goto done;
+  for (uint32_t b = 0; b < bucket_cnt - 1; b++)
+    if (inode_write_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b))
+        != DIR_BUCKET_SIZE)
+      goto done;
+
+  hdr->bucket_cnt = bucket_cnt;
+  hdr->used_cnt = 0;
+  for (size_t i = 0; i < cnt; i++)
+    if (!place (inode, hdr, &entries[i], bucket))
+      goto done;
+  success = write_header (inode, hdr);
+
+ done:
+  free (entries);
+  return success;
+}
+
+/* Creates a directory with space for ENTRY_CNT entries in the
+   given SECTOR, whose parent directory is in sector PARENT.
+   Returns true if successful, false on failure. */
+bool
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
+{
+  struct dir_header hdr;
+  hdr.parent = parent;
+  hdr.bucket_cnt = 1;
+  while (hdr.bucket_cnt * DIR_BUCKET_LEN * 3 < entry_cnt * 4)
+    hdr.bucket_cnt *= 2;
+  hdr.entry_cnt = 0;
+  hdr.used_cnt = 0;
+
+  if (!inode_create (sector, bucket_ofs (hdr.bucket_cnt), true))
+    return false;
+  struct inode *inode = inode_open (sector);
+  bool success = inode != NULL && write_header (inode, &hdr);
+  inode_close (inode);
+  return success;
+}
+
+/* Opens and returns the directory for the given INODE, of which
+   it takes ownership.  Returns a null pointer on failure. */
+struct dir *
+dir_open (struct inode *inode)
+{
+  struct dir *dir = calloc (1, sizeof *dir);
+  if (inode != NULL && dir != NULL)
+    {
+      dir->inode = inode;
+      dir->pos = 0;
+      return dir;
+    }
+  else
+    {
+      inode_close (inode);
+      free (dir);
+      return NULL;
+    }
+}
+
+/* Opens the root directory and returns a directory for it.
+   Return true if successful, false on failure. */
+struct dir *
+dir_open_root (void)
+{
+  return dir_open (inode_open (ROOT_DIR_SECTOR));
+}
+
+/* Opens and returns a new directory for the same inode as DIR.
+   Returns a null pointer on failure. */
+struct dir *
+dir_reopen (struct dir *dir)
+{
+  return dir_open (inode_reopen (dir->inode));
+}
+
+/* Destroys DIR and frees associated resources. */
+void
+dir_close (struct dir *dir)
+{
+  if (dir != NULL)
+    {
+      inode_close (dir->inode);
+      free (dir);
+    }
+}
+
+/* Returns the inode encapsulated by DIR. */
+struct inode *
+dir_get_inode (struct dir *dir)
+{
+  return dir->inode;
+}
+
+/* Searches DIR for a file with the given NAME
+   and returns true if one exists, false otherwise.
+   On success, sets *INODE to an inode for the file, otherwise to
+   a null pointer.  The caller must close *INODE.
+   Results, including failures, are remembered in the dcache, so
+   repeated lookups of a name do not read the directory.  A hit is
+   opened under the directory's lock too, since dir_remove updates
+   the dcache under it: otherwise the inode could be removed, freed
+   and its sector reused between the hit and the open. */
+bool
+dir_lookup (const struct dir *dir, const char *name,
+            struct inode **inode)
+{
+  struct dir_header hdr;
+  struct dir_entry e;
+  block_sector_t sector;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  *inode = NULL;
+  if (!strcmp (name, "."))
+    {
+      *inode = inode_reopen (dir->inode);
+      return *inode != NULL;
+    }
+  inode_lock_dir (dir->inode);
+  if (dcache_lookup (dir_sector, name, &sector))
+    {
+      if (sector != 0)
+        *inode = inode_open (sector);
+      inode_unlock_dir (dir->inode);
+      return *inode != NULL;
+    }
+
+  struct dir_entry *bucket = malloc (BLOCK_SECTOR_SIZE);
+  if (bucket == NULL)
+    {
+      inode_unlock_dir (dir->inode);
+      return false;
+    }
+
+  if (read_header (dir->inode, &hdr))
+    {
+      sector = 0;
+      if (!strcmp (name, ".."))
+        sector = hdr.parent;
+      else if (lookup (dir->inode, &hdr, name, bucket, &e, NULL))
+        sector = e.inode_sector;
+      dcache_insert (dir_sector, name, sector);
+      if (sector != 0)
+        *inode = inode_open (sector);
+    }
+  inode_unlock_dir (dir->inode);
+
+  free (bucket);
+  return *inode != NULL;
+}
+
+/* Adds a file named NAME to DIR, which must not already contain a
+   file by that name.  The file's inode is in sector
+   INODE_SECTOR.
+   Returns true if successful, false on failure.
+   Fails if NAME is invalid (i.e. too long) or a disk or memory
+   error occurs. */
+bool
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_header hdr;
+  struct dir_entry e;
+  bool success = false;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  /* Check NAME for validity. */
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
+  struct dir_entry *bucket = malloc (BLOCK_SECTOR_SIZE);
+  if (bucket == NULL)
+    return false;
+
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode) || !read_header (dir->inode, &hdr)
+      || lookup (dir->inode, &hdr, name, bucket, NULL, NULL))
+    goto done;
+
+  /* Keep the table at most 3/4 full, counting removed entries, so
+     that searches stay short.  Double it if live entries alone
+     fill more than half of it. */
+  if ((hdr.used_cnt + 1) * 4 > hdr.bucket_cnt * DIR_BUCKET_LEN * 3)
+    {
+      uint32_t bucket_cnt = hdr.bucket_cnt;
+      if ((hdr.entry_cnt + 1) * 2 > bucket_cnt * DIR_BUCKET_LEN)
+        bucket_cnt *= 2;
+      if (!rehash (dir->inode, &hdr, bucket_cnt, bucket))
+        goto done;
+    }
+
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  if (place (dir->inode, &hdr, &e, bucket))
+    {
+      hdr.entry_cnt++;
+      success = write_header (dir->inode, &hdr);
+    }
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+
+ done:
+  inode_unlock_dir (dir->inode);
+  free (bucket);
+  return success;
+}
+
+/* Removes any entry for NAME in DIR.
+   Returns true if successful, false on failure,
+   which occurs only if there is no file with the given NAME,
+   or if NAME is a directory that is not empty or that is open
+   elsewhere, for example as a working directory. */
+bool
+dir_remove (struct dir *dir, const char *name)
+{
+  struct dir_header hdr;
+  struct dir_entry e;
+  struct inode *inode = NULL;
+  bool success = false;
+  off_t ofs;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
+  struct dir_entry *bucket = malloc (BLOCK_SECTOR_SIZE);
+  if (bucket == NULL)
+    return false;
+
+  inode_lock_dir (dir->inode);
+  if (!read_header (dir->inode, &hdr)
+      || !lookup (dir->inode, &hdr, name, bucket, &e, &ofs))
+    goto done;
+
+  /* Open inode. */
+  inode = inode_open (e.inode_sector);
+  if (inode == NULL)
+    goto done;
+
+  /* Erase directory entry, leaving a tombstone behind.  A directory
+     is locked while it is checked and marked removed, so that
+     nothing can be added to it in between. */
+  bool is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      struct dir_header sub;
+      inode_lock_dir (inode);
+      if (!read_header (inode, &sub) || sub.entry_cnt > 0
+          || inode_open_cnt (inode) > 1)
+        {
+          inode_unlock_dir (inode);
+          goto done;
+        }
+    }
+  e.in_use = false;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e)
+    {
+      hdr.entry_cnt--;
+      write_header (dir->inode, &hdr);
+      inode_remove (inode);
+      dcache_insert (inode_get_inumber (dir->inode), name, 0);
+      if (is_dir)
+        dcache_invalidate_dir (e.inode_sector);
+      success = true;
+    }
+  if (is_dir)
+    inode_unlock_dir (inode);
+
+ done:
+  inode_unlock_dir (dir->inode);
+  inode_close (inode);
+  free (bucket);
+  return success;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  struct dir_header hdr;
+  struct dir_entry e;
+  bool found = false;
+
+  inode_lock_dir (dir->inode);
+  if (read_header (dir->inode, &hdr))
+    while (!found && dir->pos < (off_t) (hdr.bucket_cnt * DIR_BUCKET_LEN))
+      {
+        off_t ofs = bucket_ofs (dir->pos / DIR_BUCKET_LEN)
+                    + dir->pos % DIR_BUCKET_LEN * sizeof e;
+        dir->pos++;
+        if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+          break;
+        if (e.in_use)
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            found = true;
+          }
+      }
+  inode_unlock_dir (dir->inode);
+  return found;
+}
+
+/* Checks the directory in SECTOR, for fsck, once its inode has
+   passed inode_check().  Sets its parent to PARENT, unless PARENT is
+   0, calls CHECK on each entry in use, and removes the entries for
+   which CHECK returns false along with any that are malformed.  The
+   counts in the header are recomputed from the entries.
+   If the header itself is unusable, empties the directory and
+   returns false; otherwise returns true. */
+bool
+dir_check (block_sector_t sector, block_sector_t parent,
+           dir_check_func *check, void *aux)
+{
+  struct dir_header hdr, old;
+  struct inode *inode = inode_open (sector);
+  struct dir_entry *bucket = malloc (BLOCK_SECTOR_SIZE);
+  if (inode == NULL || bucket == NULL)
+    PANIC ("fsck: out of memory");
+
+  inode_lock_dir (inode);
+  off_t length = inode_length (inode);
+  bool valid = (read_header (inode, &hdr)
+                && hdr.bucket_cnt != 0
+                && (hdr.bucket_cnt & (hdr.bucket_cnt - 1)) == 0
+                && hdr.bucket_cnt < (uint32_t) (length / BLOCK_SECTOR_SIZE));
+  if (!valid)
+    {
+      /* Start over with one empty bucket.  Whatever the old table
+         pointed to is no longer reachable. */
+      hdr.parent = parent != 0 ? parent : ROOT_DIR_SECTOR;
+      hdr.bucket_cnt = 1;
+      hdr.entry_cnt = 0;
+      hdr.used_cnt = 0;
+      memset (bucket, 0, DIR_BUCKET_SIZE);
+      inode_write_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (0));
+      write_header (inode, &hdr);
+      goto done;
+    }
+
+  old = hdr;
+  if (parent != 0)
+    hdr.parent = parent;
+  hdr.entry_cnt = 0;
+  hdr.used_cnt = 0;
+  for (uint32_t b = 0; b < hdr.bucket_cnt; b++)
+    {
+      bool changed = false;
+      if (inode_read_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b))
+          != DIR_BUCKET_SIZE)
+        break;
+      for (size_t j = 0; j < DIR_BUCKET_LEN; j++)
+        {
+          struct dir_entry *e = &bucket[j];
+          if (e->inode_sector == 0 && !e->in_use)
+            continue;
+          hdr.used_cnt++;
+          if (!e->in_use)
+            continue;
+          if (e->inode_sector == 0 || e->name[0] == '\0'
+              || memchr (e->name, '\0', sizeof e->name) == NULL
+              || !check (e->inode_sector, e->name, aux))
+            {
+              /* Leave a tombstone.  Any sector but 0 will do. */
+              e->in_use = false;
+              if (e->inode_sector == 0)
+                e->inode_sector = ROOT_DIR_SECTOR;
+              changed = true;
+              continue;
+            }
+          hdr.entry_cnt++;
+        }
+      if (changed)
+        inode_write_at (inode, bucket, DIR_BUCKET_SIZE, bucket_ofs (b));
+    }
+  if (memcmp (&hdr, &old, sizeof hdr))
+    write_header (inode, &hdr);
+
+ done:
+  inode_unlock_dir (inode);
+  inode_close (inode);
+  free (bucket);
+  return valid;
+}
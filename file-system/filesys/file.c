@@ -0,0 +1,276 @@
+#include "filesys/file.h"
+#include <debug.h>
+#include "devices/block.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Bounds on how far ahead of a sequential reader to prefetch. */
+#define READ_AHEAD_MIN (2 * BLOCK_SECTOR_SIZE)
+#define READ_AHEAD_MAX (16 * BLOCK_SECTOR_SIZE)
+
+/* An open file. */
+struct file
+  {
+    struct inode *inode;        /* File's inode. */
+    off_t pos;                  /* Current position. */
+    bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Offset where a sequential read starts. */
+    off_t ra_window;            /* Bytes to prefetch ahead, 0 if random. */
+    off_t ra_end;               /* End of the range already prefetched. */
+  };
+
+static void read_ahead (struct file *, off_t ofs, off_t bytes_read);
+
+/* Opens a file for the given INODE, of which it takes ownership,
+   and returns the new file.  Returns a null pointer if an
+   allocation fails or if INODE is null. */
+struct file *
+file_open (struct inode *inode)
+{
+  struct file *file = calloc (1, sizeof *file);
+  if (inode != NULL && file != NULL)
+    {
+      file->inode = inode;
+      file->pos = 0;
+      file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_window = 0;
+      file->ra_end = 0;
+      return file;
+    }
+  else
+    {
+      inode_close (inode);
+      free (file);
+      return NULL;
+    }
+}
+
+/* Opens and returns a new file for the same inode as FILE.
+   Returns a null pointer if unsuccessful. */
+struct file *
+file_reopen (struct file *file)
+{
+  return file_open (inode_reopen (file->inode));
+}
+
+/* Closes FILE. */
+void
+file_close (struct file *file)
+{
+  if (file != NULL)
+    {
+      file_allow_write (file);
+      inode_close (file->inode);
+      free (file);
+    }
+}
+
+/* Returns the inode encapsulated by FILE. */
+struct inode *
+file_get_inode (struct file *file)
+{
+  return file->inode;
+}
+
+/* Updates FILE's read-ahead state after a read of BYTES_READ bytes
+   at OFS.  A read that starts where the last one ended doubles the
+   read-ahead window, up to READ_AHEAD_MAX; any other read collapses
+   it.  Whatever part of the window has not been prefetched yet is
+   then handed to the buffer cache. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  if (ofs != file->ra_next)
+    {
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  else if (bytes_read > 0)
+    {
+      file->ra_window = file->ra_window == 0 ? READ_AHEAD_MIN
+                                             : file->ra_window * 2;
+      if (file->ra_window > READ_AHEAD_MAX)
+        file->ra_window = READ_AHEAD_MAX;
+    }
+  file->ra_next = ofs + bytes_read;
+
+  if (file->ra_window == 0)
+    return;
+  off_t start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+  off_t end = file->ra_next + file->ra_window;
+  if (start < end)
+    {
+      inode_prefetch (file->inode, end - start, start);
+      file->ra_end = end;
+    }
+}
+
+/* Reads SIZE bytes from FILE into BUFFER,
+   starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than SIZE if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_read (struct file *file, void *buffer, off_t size)
+{
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from FILE into BUFFER,
+   starting at offset FILE_OFS in the file.
+   Returns the number of bytes actually read,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
+{
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into FILE,
+   starting at the file's current position.
+   Returns the number of bytes actually written,
+   which may be less than SIZE if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_write (struct file *file, const void *buffer, off_t size)
+{
+  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into FILE,
+   starting at offset FILE_OFS in the file.
+   Returns the number of bytes actually written,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_write_at (struct file *file, const void *buffer, off_t size,
+               off_t file_ofs)
+{
+  return inode_write_at (file->inode, buffer, size, file_ofs);
+}
+
+/* Reads into the CNT buffers of IOV, in turn, from FILE,
+   starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int cnt)
+{
+  off_t bytes_read = inode_readv (file->inode, iov, cnt, file->pos);
+  read_ahead (file, file->pos, bytes_read);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the CNT buffers of IOV, in turn, into FILE,
+   starting at the file's current position.
+   Returns the number of bytes actually written,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int cnt)
+{
+  off_t bytes_written = inode_writev (file->inode, iov, cnt, file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC to DST, starting at each
+   file's current position, through a kernel page instead of a
+   user buffer.  Writes after the first are sector-aligned in DST,
+   so the buffer cache never reads the sectors they replace.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if end of SRC is reached or DST cannot grow.
+   Advances both positions by the number of bytes copied. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer = palloc_get_page (0);
+  off_t bytes_copied = 0;
+
+  if (buffer == NULL)
+    return 0;
+  while (size > 0)
+    {
+      off_t chunk_size = PGSIZE - dst->pos % BLOCK_SECTOR_SIZE;
+      if (chunk_size > size)
+        chunk_size = size;
+      off_t bytes_read = file_read (src, buffer, chunk_size);
+      off_t bytes_written = file_write (dst, buffer, bytes_read);
+      bytes_copied += bytes_written;
+      size -= bytes_written;
+      if (bytes_written < chunk_size)
+        {
+          src->pos -= bytes_read - bytes_written;
+          break;
+        }
+    }
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
+/* Prevents write operations on FILE's underlying inode
+   until file_allow_write() is called or FILE is closed. */
+void
+file_deny_write (struct file *file)
+{
+  ASSERT (file != NULL);
+  if (!file->deny_write)
+    {
+      file->deny_write = true;
+      inode_deny_write (file->inode);
+    }
+}
+
+/* Re-enables write operations on FILE's underlying inode.
+   (Writes might still be denied by some other file that has the
+   same inode open.) */
+void
+file_allow_write (struct file *file)
+{
+  ASSERT (file != NULL);
+  if (file->deny_write)
+    {
+      file->deny_write = false;
+      inode_allow_write (file->inode);
+    }
+}
+
+/* Returns the size of FILE in bytes. */
+off_t
+file_length (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_length (file->inode);
+}
+
+/* Sets the current position in FILE to NEW_POS bytes from the
+   start of the file. */
+void
+file_seek (struct file *file, off_t new_pos)
+{
+  ASSERT (file != NULL);
+  ASSERT (new_pos >= 0);
+  file->pos = new_pos;
+}
+
+/* Returns the current position in FILE as an
+   offset in bytes from the start of the file. */
+off_t
+file_tell (struct file *file)
+{
+  ASSERT (file != NULL);
+  return file->pos;
+}
@@ -7,11 +7,18 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/defrag.h"
+#include "filesys/fsck.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static int get_next_part (char part[NAME_MAX + 1], const char **srcp);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static bool create (const char *name, off_t initial_size, bool is_dir);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -24,12 +31,15 @@ filesys_init (bool format)
 
   inode_init ();
   cache_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
   free_map_open ();
+  fsck_init (format);
+  defrag_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -37,23 +47,118 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_flush_delayed ();
   free_map_close ();
   cache_save();
+  fsck_done ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name part.
+   Returns 1 if successful, 0 at end of string, -1 for a too-long
+   file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that holds the last component of PATH and
+   copies that component into NAME.  Relative paths start at the
+   current thread's working directory.  NAME is set to the empty
+   string if PATH names the root directory.
+   Returns a null pointer if PATH is empty, if a component is too
+   long, or if a directory along the way does not exist. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+
+  if (*path == '\0')
+    return NULL;
+  if (*path == '/' || thread_current ()->cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (thread_current ()->cwd);
+  if (dir == NULL)
+    return NULL;
+
+  int result = get_next_part (name, &path);
+  if (result == 0)
+    name[0] = '\0';
+  while (result > 0)
+    {
+      result = get_next_part (part, &path);
+      if (result <= 0)
+        break;
+
+      /* NAME is not the last component, so descend into it. */
+      struct inode *inode;
+      if (!dir_lookup (dir, name, &inode) || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          result = -1;
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, part, NAME_MAX + 1);
+    }
+
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Creates a file named NAME with the given INITIAL_SIZE, or an
+   empty directory if IS_DIR.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
-bool
-filesys_create (const char *name, off_t initial_size) 
+static bool
+create (const char *name, off_t initial_size, bool is_dir)
 {
+  char part[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
+  struct dir *dir = resolve (name, part);
   bool success = (dir != NULL
+                  && part[0] != '\0'
                   && free_map_allocate (&inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+                  && (is_dir
+                      ? dir_create (inode_sector,
+                                    inode_get_inumber (dir_get_inode (dir)),
+                                    0)
+                      : inode_create (inode_sector, initial_size, false))
+                  && dir_add (dir, part, inode_sector));
   if (!success && inode_sector != 0) {
     free_map_release (inode_sector);
   }
@@ -62,7 +167,27 @@ filesys_create (const char *name, off_t initial_size)
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a file named NAME with the given INITIAL_SIZE.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_create (const char *name, off_t initial_size) 
+{
+  return create (name, initial_size, false);
+}
+
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
+}
+
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -70,29 +195,58 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    {
+      if (part[0] == '\0')
+        inode = inode_reopen (dir_get_inode (dir));
+      else
+        dir_lookup (dir, part, &inode);
+    }
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  bool success = dir != NULL && part[0] != '\0' && dir_remove (dir, part);
   dir_close (dir); 
 
   return success;
 }
+
+/* Changes the current thread's working directory to NAME.
+   Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name)
+{
+  struct file *file = filesys_open (name);
+  if (file == NULL)
+    return false;
+
+  struct inode *inode = file_get_inode (file);
+  struct dir *dir = NULL;
+  if (inode_is_dir (inode))
+    dir = dir_open (inode_reopen (inode));
+  file_close (file);
+  if (dir == NULL)
+    return false;
+
+  dir_close (thread_current ()->cwd);
+  thread_current ()->cwd = dir;
+  return true;
+}
 
 /* Formats the file system. */
 static void
@@ -100,7 +254,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -4,9 +4,15 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects the variables below and
+                                        FREE_MAP. */
+static size_t free_cnt;              /* Number of free sectors. */
+static size_t reserved_cnt;          /* Free sectors promised to delayed
+                                        allocations. */
 
 /* Initializes the free map. */
 void
@@ -17,36 +23,181 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, FSCK_SECTOR);
+  lock_init (&free_map_lock);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  reserved_cnt = 0;
+}
+
+/* Marks CNT sectors starting at SECTOR as used and writes the free
+   map out.  Returns false, leaving the sectors free, if the free map
+   file could not be written. */
+static bool
+mark_used (block_sector_t sector, size_t cnt)
+{
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      return false;
+    }
+  free_cnt -= cnt;
+  return true;
+}
+
+/* Allocates a sector from the free map and stores it into
+   *SECTORP.  Sectors reserved by free_map_reserve() are off limits.
+   Returns true if successful, false if no unreserved sector was
+   available or if the free_map file could not be written. */
+bool
+free_map_allocate (block_sector_t *sectorp)
+{
+  return free_map_allocate_run (1, sectorp);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Sectors reserved by free_map_reserve()
+   are off limits.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   unreserved sectors were available or if the free_map file could
+   not be written. */
 bool
-free_map_allocate (block_sector_t *sectorp)
+free_map_allocate_run (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, 1, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector = BITMAP_ERROR;
+  lock_acquire (&free_map_lock);
+  if (free_cnt - reserved_cnt >= cnt)
     {
-      bitmap_set_multiple (free_map, sector, 1, false); 
-      sector = BITMAP_ERROR;
+      sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+      if (sector != BITMAP_ERROR && !mark_used (sector, cnt))
+        sector = BITMAP_ERROR;
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Sets aside CNT free sectors for a later call to
+   free_map_allocate_reserved(), without choosing them yet.
+   Returns false if fewer than CNT unreserved sectors are free. */
+bool
+free_map_reserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  bool success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Gives back CNT sectors reserved by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Allocates up to CNT consecutive sectors out of an earlier
+   reservation and stores the first into *SECTORP.  Tries for the
+   whole run first and settles for shorter ones as free space is
+   fragmented.  Returns the number of sectors allocated, which are
+   no longer counted as reserved, or 0 if none could be. */
+size_t
+free_map_allocate_reserved (size_t cnt, block_sector_t *sectorp)
+{
+  size_t run = 0;
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  for (run = cnt; run > 0; run /= 2)
+    {
+      block_sector_t sector = bitmap_scan_and_flip (free_map, 0, run, false);
+      if (sector == BITMAP_ERROR)
+        continue;
+      if (!mark_used (sector, run))
+        run = 0;
+      else
+        {
+          reserved_cnt -= run;
+          *sectorp = sector;
+        }
+      break;
+    }
+  lock_release (&free_map_lock);
+  return run;
+}
+
+/* Makes SECTOR available for use. */
 void
 free_map_release (block_sector_t sector)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, 1));
   bitmap_set_multiple (free_map, sector, 1, false);
+  free_cnt++;
+  bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
+}
+
+/* Makes SECTOR, allocated by free_map_allocate_reserved() but not
+   used, available again as part of the reservation it came from. */
+void
+free_map_release_reserved (block_sector_t sector)
+{
+  lock_acquire (&free_map_lock);
+  reserved_cnt++;
+  lock_release (&free_map_lock);
+  free_map_release (sector);
+}
+
+/* Returns true if SECTOR is marked used. */
+bool
+free_map_is_used (block_sector_t sector)
+{
+  lock_acquire (&free_map_lock);
+  bool used = bitmap_test (free_map, sector);
+  lock_release (&free_map_lock);
+  return used;
+}
+
+/* Compares the free map against USED, which has one bit per sector
+   set for each sector found in use, in one pass over both, and
+   writes it out corrected.  Sectors in USED that are free are marked
+   used, and their number stored in *MISSING.  If EXACT, sectors not
+   in USED that are marked used are freed, and their number stored in
+   *LEAKED.  For fsck, before any sectors are reserved. */
+void
+free_map_check (const struct bitmap *used, bool exact, size_t *leaked,
+                size_t *missing)
+{
+  size_t cnt = bitmap_size (free_map);
+  ASSERT (bitmap_size (used) == cnt);
+
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt == 0);
+  *missing = 0;
+  if (exact)
+    *leaked = 0;
+  for (size_t i = 0; i < cnt; i++)
+    {
+      bool in_use = bitmap_test (used, i);
+      if (in_use == bitmap_test (free_map, i))
+        continue;
+      if (in_use)
+        ++*missing;
+      else if (exact)
+        ++*leaked;
+      else
+        continue;
+      bitmap_set (free_map, i, in_use);
+    }
+  free_cnt = bitmap_count (free_map, 0, cnt, false);
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,6 +209,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -73,7 +225,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+struct bitmap;
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -13,6 +15,14 @@ void free_map_close (void);
 
 bool free_map_available (size_t);
 bool free_map_allocate (block_sector_t *);
+bool free_map_allocate_run (size_t, block_sector_t *);
 void free_map_release (block_sector_t);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
+size_t free_map_allocate_reserved (size_t, block_sector_t *);
+void free_map_release_reserved (block_sector_t);
+bool free_map_is_used (block_sector_t);
+void free_map_check (const struct bitmap *used, bool exact, size_t *leaked,
+                     size_t *missing);
 
 #endif /* filesys/free-map.h */
@@ -0,0 +1,278 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filesys/cache.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/fsck.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+// Identifies the log in FSCK_SECTOR.
+#define FSCK_MAGIC 0x4b435346
+
+// Inodes the log can name before it gives up and asks for a full check.
+#define FSCK_LOG_LEN 124
+
+// Log of the inodes whose metadata may have changed since the file
+// system was last unmounted cleanly. It is written straight to the
+// device, never through the cache, so that an inode is on the log on
+// disk before any change to it can be.
+struct fsck_log {
+  unsigned magic;
+  uint32_t clean;    // Nonzero if nothing has changed since unmount
+  uint32_t overflow; // Nonzero if more inodes changed than fit in SECTORS
+  uint32_t cnt;      // Number of valid entries in SECTORS
+  uint32_t sectors[FSCK_LOG_LEN];
+};
+
+// A directory found by the full check whose entries are still to be
+// checked.
+struct pending_dir {
+  struct list_elem elem;
+  block_sector_t sector;
+  block_sector_t parent;
+};
+
+// State of a check in progress.
+struct check {
+  struct bitmap *claimed; // Sectors found in use so far
+  struct list dirs;       // Directories to visit, for a full check
+  block_sector_t dir;     // Directory being visited
+  int problems;           // Problems found so far
+};
+
+static struct fsck_log fsck_log;
+static struct lock fsck_lock; // Protects fsck_log and logging
+static bool logging;          // Is the log in use?
+
+static bool full_check(struct check *);
+static void incremental_check(struct check *);
+
+static void write_log(void) {
+  block_write(fs_device, FSCK_SECTOR, &fsck_log);
+}
+
+// Checks the file system, if it was not unmounted cleanly, and starts
+// logging changed inodes. A log that has overflowed or cannot be read
+// calls for a full check, which walks the whole tree; otherwise only
+// the inodes on the log are checked, so that recovery time depends on
+// how much changed and not on the size of the disk. Runs after the
+// free map is opened and before anything else uses the file system.
+void fsck_init(bool format) {
+  ASSERT(sizeof fsck_log == BLOCK_SECTOR_SIZE);
+  lock_init(&fsck_lock);
+  logging = false;
+
+  bool own_log = true;
+  if (!format) {
+    block_read(fs_device, FSCK_SECTOR, &fsck_log);
+    bool valid = fsck_log.magic == FSCK_MAGIC && fsck_log.cnt <= FSCK_LOG_LEN;
+    if (!valid || !fsck_log.clean) {
+      struct check check;
+      check.claimed = bitmap_create(block_size(fs_device));
+      if (check.claimed == NULL) {
+        PANIC("fsck: out of memory");
+      }
+      check.problems = 0;
+      if (!valid || fsck_log.overflow) {
+        // Without a log the log sector may even hold file data.
+        printf("fsck: checking whole file system\n");
+        own_log = full_check(&check);
+      } else {
+        printf("fsck: checking %u changed inodes\n", (unsigned) fsck_log.cnt);
+        incremental_check(&check);
+      }
+      bitmap_destroy(check.claimed);
+      cache_save();
+      printf("fsck: %d problems fixed\n", check.problems);
+    }
+  }
+
+  if (!own_log) {
+    printf("fsck: sector %d is in use, changes will not be logged\n",
+           FSCK_SECTOR);
+    return;
+  }
+  memset(&fsck_log, 0, sizeof fsck_log);
+  fsck_log.magic = FSCK_MAGIC;
+  fsck_log.clean = 1;
+  write_log();
+  logging = true;
+}
+
+// Records that the metadata of the inode in SECTOR is about to change,
+// so that an unclean shutdown gets it checked. Called before every
+// change to an inode's length, blocks or directory entries.
+void fsck_mark_dirty(block_sector_t sector) {
+  lock_acquire(&fsck_lock);
+  if (logging && !fsck_log.overflow) {
+    uint32_t i;
+    for (i = 0; i < fsck_log.cnt; i++) {
+      if (fsck_log.sectors[i] == sector) {
+        break;
+      }
+    }
+    if (i == fsck_log.cnt) {
+      if (fsck_log.cnt < FSCK_LOG_LEN) {
+        fsck_log.sectors[fsck_log.cnt++] = sector;
+      } else {
+        fsck_log.overflow = 1;
+      }
+      fsck_log.clean = 0;
+      write_log();
+    }
+  }
+  lock_release(&fsck_lock);
+}
+
+// Marks the file system clean. Must be called after everything else
+// has been written out.
+void fsck_done(void) {
+  lock_acquire(&fsck_lock);
+  if (logging) {
+    memset(&fsck_log, 0, sizeof fsck_log);
+    fsck_log.magic = FSCK_MAGIC;
+    fsck_log.clean = 1;
+    write_log();
+  }
+  lock_release(&fsck_lock);
+}
+
+// Claims SECTOR for CHECK. Returns false if it is out of range or
+// claimed already.
+static bool claim(struct check *check, block_sector_t sector) {
+  if (sector >= bitmap_size(check->claimed)
+      || bitmap_test(check->claimed, sector)) {
+    return false;
+  }
+  bitmap_mark(check->claimed, sector);
+  return true;
+}
+
+// Queues directory SECTOR, found in the directory CHECK is visiting,
+// for a visit of its own.
+static void queue_dir(struct check *check, block_sector_t sector) {
+  struct pending_dir *p = malloc(sizeof *p);
+  if (p == NULL) {
+    PANIC("fsck: out of memory");
+  }
+  p->sector = sector;
+  p->parent = check->dir;
+  list_push_back(&check->dirs, &p->elem);
+}
+
+// Checks the inode that entry NAME of the directory being walked by a
+// full check points to, claiming it and its blocks. Directories are
+// queued for a later visit rather than walked now, so that deep trees
+// do not use up the stack. An entry whose inode is damaged, or is
+// already reachable some other way, is dropped.
+static bool check_entry(block_sector_t sector, const char *name, void *aux) {
+  struct check *check = aux;
+  bool is_dir;
+  if (!claim(check, sector)) {
+    printf("fsck: %s: inode %"PRDSNu" is out of range or linked twice\n",
+           name, sector);
+    check->problems++;
+    return false;
+  }
+  if (!inode_check(sector, check->claimed, &is_dir)) {
+    bitmap_reset(check->claimed, sector);
+    printf("fsck: %s: inode %"PRDSNu" is damaged\n", name, sector);
+    check->problems++;
+    return false;
+  }
+  if (is_dir) {
+    queue_dir(check, sector);
+  }
+  return true;
+}
+
+// Finds every sector reachable from the root directory, fixing what it
+// can on the way, and then makes the free map agree with it in one
+// pass. Returns false if a file turned out to be using FSCK_SECTOR.
+static bool full_check(struct check *check) {
+  bool is_dir;
+  bitmap_mark(check->claimed, FREE_MAP_SECTOR);
+  bitmap_mark(check->claimed, ROOT_DIR_SECTOR);
+  if (!inode_check(FREE_MAP_SECTOR, check->claimed, NULL)) {
+    PANIC("fsck: free map inode is damaged");
+  }
+  if (!inode_check(ROOT_DIR_SECTOR, check->claimed, &is_dir) || !is_dir) {
+    PANIC("fsck: root directory inode is damaged");
+  }
+
+  list_init(&check->dirs);
+  check->dir = ROOT_DIR_SECTOR;
+  queue_dir(check, ROOT_DIR_SECTOR);
+  while (!list_empty(&check->dirs)) {
+    struct pending_dir *p =
+      list_entry(list_pop_front(&check->dirs), struct pending_dir, elem);
+    check->dir = p->sector;
+    if (!dir_check(p->sector, p->parent, check_entry, check)) {
+      printf("fsck: directory %"PRDSNu" is damaged, emptied it\n", p->sector);
+      check->problems++;
+    }
+    free(p);
+  }
+
+  bool own_log = claim(check, FSCK_SECTOR);
+
+  size_t leaked, missing;
+  free_map_check(check->claimed, true, &leaked, &missing);
+  if (leaked > 0 || missing > 0) {
+    printf("fsck: free map: %zu sectors leaked, %zu in use but free\n",
+           leaked, missing);
+    check->problems++;
+  }
+  return own_log;
+}
+
+// Checks that entry NAME of a changed directory points to an inode.
+static bool probe_entry(block_sector_t sector, const char *name, void *aux) {
+  struct check *check = aux;
+  if (sector >= bitmap_size(check->claimed) || !free_map_is_used(sector)
+      || !inode_check(sector, NULL, NULL)) {
+    printf("fsck: %s: inode %"PRDSNu" is missing\n", name, sector);
+    check->problems++;
+    return false;
+  }
+  return true;
+}
+
+// Checks only the inodes on the log, then marks every block they use
+// as used in the free map. An inode whose sector is free again was
+// removed, and one that no longer looks like an inode was removed and
+// its sector reused, so both are skipped. Blocks leaked by a removal
+// that did not finish stay leaked until the next full check.
+static void incremental_check(struct check *check) {
+  for (uint32_t i = 0; i < fsck_log.cnt; i++) {
+    block_sector_t sector = fsck_log.sectors[i];
+    bool is_dir;
+    if (sector >= bitmap_size(check->claimed) || !free_map_is_used(sector)
+        || !claim(check, sector)) {
+      continue;
+    }
+    if (!inode_check(sector, check->claimed, &is_dir)) {
+      bitmap_reset(check->claimed, sector);
+      continue;
+    }
+    if (is_dir && !dir_check(sector, 0, probe_entry, check)) {
+      printf("fsck: directory %"PRDSNu" is damaged, emptied it\n", sector);
+      check->problems++;
+    }
+  }
+
+  size_t missing;
+  free_map_check(check->claimed, false, NULL, &missing);
+  if (missing > 0) {
+    printf("fsck: free map: %zu sectors in use but free\n", missing);
+    check->problems++;
+  }
+}
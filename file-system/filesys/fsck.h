@@ -0,0 +1,11 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void fsck_init(bool format);
+void fsck_mark_dirty(block_sector_t sector);
+void fsck_done(void);
+
+#endif /* filesys/fsck.h */
@@ -1,20 +1,26 @@
 #include "filesys/inode.h"
+#include <bitmap.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <iovec.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
+#include "filesys/fsck.h"
 
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-#define NUM_DIRECT 188
+#define NUM_DIRECT 187
 #define NUM_INDIRECT 64
 #define INDIRECT_LEN 256
 
@@ -22,16 +28,69 @@
 // BLOCK_SECTOR_SIZE * (NUM_DIRECT + BLOCK_SECTOR_SIZE * NUM_INDIRECT)
 #define MAX_INODE_LEN (8 * 1024 * 1024)
 
+// Files no longer than this keep their data in the inode sector itself,
+// in the space that larger files use for block indices.
+#define INLINE_LEN ((NUM_DIRECT + NUM_INDIRECT) * sizeof(uint16_t))
+
+// Most sectors an inode buffers past its allocated ones before they
+// are given places on disk.
+#define DELAYED_MAX 32
+
+// Compressed files are stored in chunks of CHUNK_SECTORS sectors. Chunk
+// C owns the block pointers of sectors C * CHUNK_SECTORS onward. If it
+// compresses to fewer sectors, only the first few pointers are used and
+// the data starts with its compressed length; otherwise the chunk is
+// stored as is in all of them. A chunk never written has no sectors.
+#define CHUNK_SECTORS 8
+#define CHUNK_SIZE (CHUNK_SECTORS * BLOCK_SECTOR_SIZE)
+#define CHUNK_BUFS 2 // Decompressed chunks kept per open inode
+
+/* Bits for inode_disk's flags. */
+#define INODE_DIR 0x1                   /* Inode is a directory. */
+#define INODE_COMPRESSED 0x2            /* Data is stored compressed. */
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint16_t direct[NUM_DIRECT];        /* Direct block indices. */
-    uint16_t indirect[NUM_INDIRECT];    /* Indirect block indices. */
+    uint16_t flags;                     /* INODE_* bits. */
+    union
+      {
+        struct
+          {
+            uint16_t direct[NUM_DIRECT];      /* Direct block indices. */
+            uint16_t indirect[NUM_INDIRECT];  /* Indirect block indices. */
+          };
+        uint8_t inline_data[INLINE_LEN];      /* Data of an inline file. */
+      };
   };
 
+/* Returns true if DISK stores its data in compressed chunks. */
+static inline bool
+is_compressed (const struct inode_disk *disk)
+{
+  return (disk->flags & INODE_COMPRESSED) != 0;
+}
+
+/* Returns true if DISK stores its data inline rather than in
+   blocks.  Once a file grows past INLINE_LEN it never goes back.
+   Compressed files are never inline. */
+static inline bool
+is_inline (const struct inode_disk *disk)
+{
+  return !is_compressed (disk) && disk->length <= (off_t) INLINE_LEN;
+}
+
+/* Returns true if DISK's data may only be accessed with the inode
+   lock held, as inline and compressed data are. */
+static inline bool
+needs_lock (const struct inode_disk *disk)
+{
+  return is_inline (disk) || is_compressed (disk);
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -40,6 +99,24 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* In-memory copy of an inode's indirect blocks, so that mapping
+   an offset past the direct blocks does not go through the cache.
+   Each entry of INDIRECT mirrors the indirect block of the same
+   index and is loaded the first time that block is looked up. */
+struct block_map
+  {
+    struct lock lock;                   /* Serializes loads and appends. */
+    uint16_t *indirect[NUM_INDIRECT];   /* Loaded indirect blocks or NULL. */
+  };
+
+/* A decompressed chunk of a compressed file. */
+struct chunk_buf
+  {
+    int idx;                            /* Chunk held, or -1. */
+    bool dirty;                         /* Changed since last stored? */
+    uint8_t *data;                      /* CHUNK_SIZE bytes, or NULL. */
+  };
+
 /* In-memory inode. */
 struct inode 
   {
@@ -48,8 +125,23 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct lock lock;                   /* For all read/write operations. */
+    int io_cnt;                         /* Block reads/writes underway. */
+    bool relocating;                    /* Blocks are being moved. */
+    struct condition io_idle;           /* Signaled when IO_CNT drops to
+                                           0 or RELOCATING is cleared. */
+    struct lock lock;                   /* Protects the fields above,
+                                           LENGTH, the delayed sectors
+                                           and the chunk buffers. */
+    struct lock extend_lock;            /* Serializes writes past EOF. */
+    struct lock dir_lock;               /* Serializes directory operations. */
+    off_t length;                       /* Length visible to readers. */
+    struct block_map map;               /* Cached indirect blocks. */
     struct inode_disk data;             /* Inode content. */
+    uint8_t *delayed;                   /* Data of the sectors past the
+                                           allocated ones, or NULL. */
+    int delayed_cnt;                    /* Number of delayed sectors. */
+    struct chunk_buf chunks[CHUNK_BUFS]; /* Chunks of compressed data. */
+    int next_chunk;                     /* Next of CHUNKS to reuse. */
   };
 
 static block_sector_t
@@ -57,7 +149,7 @@ byte_to_sector_disk (const struct inode_disk *disk, off_t pos)
 {
   ASSERT (disk != NULL);
   ASSERT(pos >= 0);
-  if (pos >= disk->length) {
+  if (pos >= disk->length || is_inline(disk)) {
     return -1;
   }
   
@@ -68,21 +160,70 @@ byte_to_sector_disk (const struct inode_disk *disk, off_t pos)
     int ind_idx = (idx - NUM_DIRECT) / INDIRECT_LEN;
     int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
     uint16_t dir_idx;
-    cache_read(disk->indirect[ind_idx], &dir_idx, sizeof(uint16_t), ind_ofs);
+    cache_read(disk->indirect[ind_idx], &dir_idx, sizeof(uint16_t),
+               ind_ofs * sizeof(uint16_t));
     return dir_idx;
   }
 }
 
+/* Returns the in-memory copy of indirect block IND_IDX of DISK,
+   reading it in first if MAP does not have it yet.
+   Returns NULL if memory allocation fails. */
+static uint16_t *
+block_map_load (struct block_map *map, const struct inode_disk *disk,
+                int ind_idx)
+{
+  uint16_t *block = map->indirect[ind_idx];
+  if (block != NULL)
+    return block;
+
+  lock_acquire(&map->lock);
+  block = map->indirect[ind_idx];
+  if (block == NULL) {
+    block = malloc(BLOCK_SECTOR_SIZE);
+    if (block != NULL) {
+      cache_read(disk->indirect[ind_idx], block, BLOCK_SECTOR_SIZE, 0);
+      map->indirect[ind_idx] = block;
+    }
+  }
+  lock_release(&map->lock);
+  return block;
+}
+
+/* Frees every indirect block loaded into MAP. */
+static void
+block_map_free (struct block_map *map)
+{
+  for (int i = 0; i < NUM_INDIRECT; i++) {
+    free(map->indirect[i]);
+    map->indirect[i] = NULL;
+  }
+}
+
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS.
+   The block map only ever grows, and a sector is mapped before
+   the readable length covers it, so this needs no lock as long as
+   POS is below a length snapshot taken under INODE's lock. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
-  ASSERT(lock_held_by_current_thread(&inode->lock));
-  return byte_to_sector_disk(&inode->data, pos);
+  ASSERT(pos >= 0);
+  int idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < NUM_DIRECT || pos >= inode->data.length) {
+    return byte_to_sector_disk(&inode->data, pos);
+  }
+
+  int ind_idx = (idx - NUM_DIRECT) / INDIRECT_LEN;
+  int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
+  uint16_t *block = block_map_load(&inode->map, &inode->data, ind_idx);
+  if (block == NULL) {
+    return byte_to_sector_disk(&inode->data, pos);
+  }
+  return block[ind_ofs];
 }
 
 static bool allocate_short(uint16_t *shortp) {
@@ -100,7 +241,12 @@ static bool allocate_short(uint16_t *shortp) {
   return true;
 }
 
-static bool append_sector(struct inode_disk *disk) {
+/* Adds SECTOR, which is already allocated, at the end of DISK,
+   allocating an indirect block for it if needed.  MAP, if nonnull,
+   is the block map of the open inode that DISK belongs to, and is
+   updated along with the on-disk indirect block. */
+static bool append_sector_at(struct inode_disk *disk, struct block_map *map,
+                             uint16_t sector) {
   ASSERT(disk != NULL);
   off_t new_length = ROUND_UP(disk->length, BLOCK_SECTOR_SIZE) + BLOCK_SECTOR_SIZE;
   if (new_length > MAX_INODE_LEN) {
@@ -108,36 +254,59 @@ static bool append_sector(struct inode_disk *disk) {
   }
   int idx = (new_length - 1) / BLOCK_SECTOR_SIZE;
   if (idx < NUM_DIRECT) {
-    if (!allocate_short(&disk->direct[idx])) {
-      return false;
-    }
+    disk->direct[idx] = sector;
   } else {
-    int old_idx = (disk->length - 1) / BLOCK_SECTOR_SIZE;
-    int old_ind_idx = (old_idx - NUM_DIRECT) / INDIRECT_LEN;
     int ind_idx = (idx - NUM_DIRECT) / INDIRECT_LEN;
-    if (ind_idx > old_ind_idx && !allocate_short(&disk->indirect[ind_idx])) {
+    int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
+    if (ind_ofs == 0 && !allocate_short(&disk->indirect[ind_idx])) {
       return false;
     }
-    uint16_t dir_idx;
-    if (!allocate_short(&dir_idx)) {
-      if (ind_idx > old_ind_idx) {
-        free_map_release(disk->indirect[ind_idx]);
+    if (map != NULL) {
+      lock_acquire(&map->lock);
+    }
+    cache_write(disk->indirect[ind_idx], &sector, sizeof(uint16_t),
+                ind_ofs * sizeof(uint16_t));
+    if (map != NULL) {
+      if (map->indirect[ind_idx] != NULL) {
+        map->indirect[ind_idx][ind_ofs] = sector;
       }
-      return false;
+      lock_release(&map->lock);
     }
-    int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
-    cache_write(disk->indirect[ind_idx], &dir_idx, sizeof(uint16_t), ind_ofs);
   }
   disk->length = new_length;
   return true;
 }
 
-static off_t extend_disk(struct inode_disk *disk, off_t length) {
+/* Allocates one more sector at the end of DISK, as
+   append_sector_at() does. */
+static bool append_sector(struct inode_disk *disk, struct block_map *map) {
+  uint16_t sector;
+  if (!allocate_short(&sector)) {
+    return false;
+  }
+  if (!append_sector_at(disk, map, sector)) {
+    free_map_release(sector);
+    return false;
+  }
+  return true;
+}
+
+/* Grows DISK to LENGTH bytes, or as close to it as disk space
+   allows, and returns the new length.  DISK must either be empty or
+   already be stored in blocks unless LENGTH still fits inline;
+   moving existing inline data into blocks is up to the caller. */
+static off_t extend_disk(struct inode_disk *disk, struct block_map *map,
+                         off_t length) {
   if (disk->length >= length) {
     return disk->length;
   }
+  if (length <= (off_t) INLINE_LEN) {
+    disk->length = length;
+    return disk->length;
+  }
+  ASSERT(disk->length == 0 || !is_inline(disk));
   disk->length = ROUND_UP(disk->length, BLOCK_SECTOR_SIZE);
-  while (disk->length < length && append_sector(disk)) {
+  while (disk->length < length && append_sector(disk, map)) {
   }
   if (disk->length > length) {
     disk->length = length;
@@ -145,29 +314,500 @@ static off_t extend_disk(struct inode_disk *disk, off_t length) {
   return disk->length;
 }
 
+/* Returns the block pointer for sector IDX of compressed DISK, or 0
+   if that sector has no block. */
+static block_sector_t get_slot(const struct inode_disk *disk, int idx) {
+  if (idx < NUM_DIRECT) {
+    return disk->direct[idx];
+  }
+  int ind_idx = (idx - NUM_DIRECT) / INDIRECT_LEN;
+  int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
+  if (disk->indirect[ind_idx] == 0) {
+    return 0;
+  }
+  uint16_t sector;
+  cache_read(disk->indirect[ind_idx], &sector, sizeof sector,
+             ind_ofs * sizeof sector);
+  return sector;
+}
+
+/* Sets the block pointer for sector IDX of compressed DISK to SECTOR,
+   allocating the indirect block that holds it if needed. */
+static bool set_slot(struct inode_disk *disk, int idx, uint16_t sector) {
+  if (idx < NUM_DIRECT) {
+    disk->direct[idx] = sector;
+    return true;
+  }
+  int ind_idx = (idx - NUM_DIRECT) / INDIRECT_LEN;
+  int ind_ofs = (idx - NUM_DIRECT) % INDIRECT_LEN;
+  if (disk->indirect[ind_idx] == 0) {
+    if (sector == 0) {
+      return true;
+    }
+    if (!allocate_short(&disk->indirect[ind_idx])) {
+      return false;
+    }
+  }
+  cache_write(disk->indirect[ind_idx], &sector, sizeof sector,
+              ind_ofs * sizeof sector);
+  return true;
+}
+
+/* Releases every data and indirect block of DISK. */
+static void release_blocks(const struct inode_disk *disk) {
+  if (is_compressed(disk)) {
+    int slots = ROUND_UP(bytes_to_sectors(disk->length), CHUNK_SECTORS);
+    for (int i = 0; i < slots; i++) {
+      block_sector_t sector = get_slot(disk, i);
+      if (sector != 0) {
+        free_map_release(sector);
+      }
+    }
+    for (int i = 0; i < NUM_INDIRECT; i++) {
+      if (disk->indirect[i] != 0) {
+        free_map_release(disk->indirect[i]);
+      }
+    }
+    return;
+  }
+  if (is_inline(disk)) {
+    return;
+  }
+  for (off_t ofs = 0; ofs < disk->length; ofs += BLOCK_SECTOR_SIZE) {
+    free_map_release(byte_to_sector_disk(disk, ofs));
+  }
+  int sectors = bytes_to_sectors(disk->length);
+  if (sectors > NUM_DIRECT) {
+    int num_indirect = DIV_ROUND_UP(sectors - NUM_DIRECT, INDIRECT_LEN);
+    for (int i = 0; i < num_indirect; i++) {
+      free_map_release(disk->indirect[i]);
+    }
+  }
+}
+
+/* Moves INODE's inline data out to blocks while growing it to POS
+   bytes.  The switch to the block layout happens under INODE's
+   lock, where readers of inline data look. */
+static off_t promote(struct inode *inode, off_t pos) {
+  struct inode_disk *disk = calloc(1, sizeof *disk);
+  if (disk == NULL) {
+    return inode->data.length;
+  }
+  disk->magic = INODE_MAGIC;
+  disk->flags = inode->data.flags;
+  if (extend_disk(disk, NULL, pos) <= (off_t) INLINE_LEN) {
+    free(disk);
+    return inode->data.length;
+  }
+
+  lock_acquire(&inode->lock);
+  off_t old_length = inode->data.length;
+  for (off_t ofs = 0; ofs < old_length; ofs += BLOCK_SECTOR_SIZE) {
+    int chunk_size = old_length - ofs < BLOCK_SECTOR_SIZE
+      ? old_length - ofs : BLOCK_SECTOR_SIZE;
+    cache_write(byte_to_sector_disk(disk, ofs), inode->data.inline_data + ofs,
+                chunk_size, 0);
+  }
+  memcpy(&inode->data, disk, sizeof *disk);
+  lock_release(&inode->lock);
+  free(disk);
+  return inode->data.length;
+}
+
+/* Returns the offset just past the sectors allocated to INODE,
+   which is where its delayed sectors start. */
+static inline off_t allocated_end(const struct inode *inode) {
+  return ROUND_UP(inode->data.length, BLOCK_SECTOR_SIZE);
+}
+
+/* Gives INODE's delayed sectors places on disk, in as few runs as
+   free space allows, and writes their data out through the cache.
+   Sectors that cannot be placed stay delayed. */
+static void flush_delayed(struct inode *inode) {
+  ASSERT(lock_held_by_current_thread(&inode->extend_lock));
+  lock_acquire(&inode->lock);
+  int cnt = inode->delayed_cnt;
+  if (cnt == 0) {
+    lock_release(&inode->lock);
+    return;
+  }
+  int done = 0;
+  while (done < cnt) {
+    block_sector_t first;
+    int run = free_map_allocate_reserved(cnt - done, &first);
+    if (run == 0) {
+      break;
+    }
+    // The data goes into the cache before the sector is mapped, since
+    // readers stop asking for delayed data once it is.
+    int used = 0;
+    for (; used < run && first + used <= UINT16_MAX; used++) {
+      cache_write(first + used, inode->delayed + (done + used) * BLOCK_SECTOR_SIZE,
+                  BLOCK_SECTOR_SIZE, 0);
+      if (!append_sector_at(&inode->data, &inode->map, first + used)) {
+        break;
+      }
+    }
+    for (int i = used; i < run; i++) {
+      free_map_release_reserved(first + i);
+    }
+    done += used;
+    if (used < run) {
+      break;
+    }
+  }
+
+  int left = cnt - done;
+  if (left == 0) {
+    free(inode->delayed);
+    inode->delayed = NULL;
+  } else if (done > 0) {
+    memmove(inode->delayed, inode->delayed + done * BLOCK_SECTOR_SIZE,
+            left * BLOCK_SECTOR_SIZE);
+    memset(inode->delayed + left * BLOCK_SECTOR_SIZE, 0,
+           done * BLOCK_SECTOR_SIZE);
+  }
+  inode->delayed_cnt = left;
+  if (inode->data.length > inode->length) {
+    inode->data.length = inode->length;
+  }
+  cache_write(inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+  lock_release(&inode->lock);
+}
+
+/* Grows INODE to POS bytes, or as close to it as disk space allows,
+   and returns the new length.  Sectors past the ones INODE already
+   has are only reserved and buffered in memory, up to DELAYED_MAX of
+   them, so that flush_delayed() can later place them all in one run.
+   Growth further out than that is allocated right away. */
 static off_t extend(struct inode *inode, off_t pos) {
+  ASSERT(lock_held_by_current_thread(&inode->extend_lock));
+  fsck_mark_dirty(inode->sector);
+  if (pos > MAX_INODE_LEN) {
+    pos = MAX_INODE_LEN;
+  }
+  if (is_compressed(&inode->data)) {
+    // Chunks get their sectors when they are stored.
+    lock_acquire(&inode->lock);
+    if (inode->data.length < pos) {
+      inode->data.length = pos;
+    }
+    lock_release(&inode->lock);
+    return inode->data.length;
+  }
+  if (is_inline(&inode->data) && inode->data.length < pos) {
+    if (pos > (off_t) INLINE_LEN) {
+      return promote(inode, pos);
+    }
+    lock_acquire(&inode->lock);
+    inode->data.length = pos;
+    lock_release(&inode->lock);
+    return pos;
+  }
+
+  off_t start = allocated_end(inode);
+  if (pos <= start) {
+    return extend_disk(&inode->data, &inode->map, pos);
+  }
+  int need = bytes_to_sectors(pos - start);
+  if (need > DELAYED_MAX) {
+    flush_delayed(inode);
+    if (inode->delayed_cnt > 0) {
+      return inode->length;
+    }
+    return extend_disk(&inode->data, &inode->map, pos);
+  }
+  if (inode->delayed == NULL) {
+    uint8_t *delayed = calloc(DELAYED_MAX, BLOCK_SECTOR_SIZE);
+    if (delayed == NULL) {
+      return extend_disk(&inode->data, &inode->map, pos);
+    }
+    lock_acquire(&inode->lock);
+    inode->delayed = delayed;
+    lock_release(&inode->lock);
+  }
+  if (need > inode->delayed_cnt
+      && !free_map_reserve(need - inode->delayed_cnt)) {
+    if (inode->delayed_cnt == 0) {
+      return extend_disk(&inode->data, &inode->map, pos);
+    }
+    return inode->length;
+  }
+
+  lock_acquire(&inode->lock);
+  if (need > inode->delayed_cnt) {
+    inode->delayed_cnt = need;
+  }
+  inode->data.length = start;
+  lock_release(&inode->lock);
+  return pos;
+}
+
+/* Copies SIZE bytes at OFFSET between BUFFER and INODE's delayed
+   sectors, if that is where OFFSET lies, and returns true.  Returns
+   false if OFFSET is within INODE's allocated sectors.  The range
+   must not cross a sector boundary. */
+static bool copy_delayed(struct inode *inode, uint8_t *buffer, int size,
+                         off_t offset, bool write) {
+  // Allocated sectors stay allocated, so this check needs no lock.
+  if (offset < inode->data.length) {
+    return false;
+  }
+  lock_acquire(&inode->lock);
+  off_t start = allocated_end(inode);
+  bool delayed = inode->delayed_cnt > 0 && offset >= start;
+  if (delayed) {
+    ASSERT(offset + size <= start + inode->delayed_cnt * BLOCK_SECTOR_SIZE);
+    uint8_t *data = inode->delayed + (offset - start);
+    if (write) {
+      memcpy(data, buffer, size);
+    } else {
+      memcpy(buffer, data, size);
+    }
+  }
+  lock_release(&inode->lock);
+  return delayed;
+}
+
+/* Copies up to SIZE bytes at OFFSET between BUFFER and the inline
+   data of INODE, which is LENGTH bytes long, writing them back to
+   the inode sector if WRITE.  Returns the number of bytes copied. */
+static off_t copy_inline(struct inode *inode, uint8_t *buffer, off_t size,
+                         off_t offset, off_t length, bool write) {
+  ASSERT(lock_held_by_current_thread(&inode->lock));
+  ASSERT(is_inline(&inode->data));
+  if (offset >= length) {
+    return 0;
+  }
+  if (size > length - offset) {
+    size = length - offset;
+  }
+  if (write) {
+    memcpy(inode->data.inline_data + offset, buffer, size);
+    cache_write(inode->sector, buffer, size,
+                offsetof(struct inode_disk, inline_data) + offset);
+  } else {
+    memcpy(buffer, inode->data.inline_data + offset, size);
+  }
+  return size;
+}
+
+/* Reads chunk IDX of compressed INODE into BUF.  Returns false,
+   leaving BUF holding no chunk, if the chunk cannot be decompressed
+   for lack of memory or because it is corrupt: zeros in its place
+   would be returned as data, and written back over it. */
+static bool load_chunk(struct inode *inode, struct chunk_buf *buf, int idx) {
+  const struct inode_disk *disk = &inode->data;
+  int base = idx * CHUNK_SECTORS;
+  buf->idx = -1;
+  buf->dirty = false;
+
+  block_sector_t first = get_slot(disk, base);
+  if (first == 0) {
+    memset(buf->data, 0, CHUNK_SIZE);
+    buf->idx = idx;
+    return true;
+  }
+  if (get_slot(disk, base + CHUNK_SECTORS - 1) != 0) {
+    for (int i = 0; i < CHUNK_SECTORS; i++) {
+      cache_read(get_slot(disk, base + i), buf->data + i * BLOCK_SECTOR_SIZE,
+                 BLOCK_SECTOR_SIZE, 0);
+    }
+    buf->idx = idx;
+    return true;
+  }
+
+  uint16_t len;
+  cache_read(first, &len, sizeof len, 0);
+  if (len + sizeof len > (CHUNK_SECTORS - 1) * BLOCK_SECTOR_SIZE) {
+    return false;
+  }
+  uint8_t *packed = malloc(CHUNK_SIZE);
+  if (packed == NULL) {
+    return false;
+  }
+  int cnt = bytes_to_sectors(len + sizeof len);
+  for (int i = 0; i < cnt; i++) {
+    cache_read(get_slot(disk, base + i), packed + i * BLOCK_SECTOR_SIZE,
+               BLOCK_SECTOR_SIZE, 0);
+  }
+  size_t size = lz_decompress(packed + sizeof len, len, buf->data, CHUNK_SIZE);
+  memset(buf->data + size, 0, CHUNK_SIZE - size);
+  free(packed);
+  buf->idx = idx;
+  return true;
+}
+
+/* Writes BUF back to its chunk of compressed INODE, compressed if
+   that saves at least one sector, and gives back the sectors the
+   chunk no longer needs.  Returns false, leaving BUF dirty, if disk
+   space runs out. */
+static bool store_chunk(struct inode *inode, struct chunk_buf *buf) {
+  struct inode_disk *disk = &inode->data;
+  fsck_mark_dirty(inode->sector);
+  uint8_t *packed = malloc(CHUNK_SIZE);
+  uint16_t len = 0;
+  if (packed != NULL) {
+    len = lz_compress(buf->data, CHUNK_SIZE, packed + sizeof len,
+                      (CHUNK_SECTORS - 1) * BLOCK_SECTOR_SIZE - sizeof len);
+  }
+  const uint8_t *src = buf->data;
+  int cnt = CHUNK_SECTORS;
+  if (len > 0) {
+    memcpy(packed, &len, sizeof len);
+    src = packed;
+    cnt = bytes_to_sectors(len + sizeof len);
+  }
+
+  int base = buf->idx * CHUNK_SECTORS;
+  bool success = true;
+  for (int i = 0; success && i < cnt; i++) {
+    uint16_t sector;
+    if (get_slot(disk, base + i) != 0) {
+      continue;
+    }
+    if (!allocate_short(&sector)) {
+      success = false;
+    } else if (!set_slot(disk, base + i, sector)) {
+      free_map_release(sector);
+      success = false;
+    }
+  }
+  if (success) {
+    for (int i = 0; i < CHUNK_SECTORS; i++) {
+      block_sector_t sector = get_slot(disk, base + i);
+      if (i < cnt) {
+        cache_write(sector, src + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE, 0);
+      } else if (sector != 0) {
+        set_slot(disk, base + i, 0);
+        free_map_release(sector);
+      }
+    }
+    buf->dirty = false;
+  }
+  cache_write(inode->sector, disk, BLOCK_SECTOR_SIZE, 0);
+  free(packed);
+  return success;
+}
+
+/* Stores every dirty chunk buffer of compressed INODE. */
+static void store_chunks(struct inode *inode) {
+  ASSERT(lock_held_by_current_thread(&inode->lock));
+  for (int i = 0; i < CHUNK_BUFS; i++) {
+    if (inode->chunks[i].data != NULL && inode->chunks[i].dirty) {
+      store_chunk(inode, &inode->chunks[i]);
+    }
+  }
+}
+
+/* Returns a buffer holding chunk IDX of compressed INODE, loading it
+   over the least recently loaded one if needed.  Returns NULL if
+   memory runs out, the chunk being replaced cannot be stored or
+   chunk IDX cannot be loaded. */
+static struct chunk_buf *get_chunk(struct inode *inode, int idx) {
+  ASSERT(lock_held_by_current_thread(&inode->lock));
+  for (int i = 0; i < CHUNK_BUFS; i++) {
+    if (inode->chunks[i].data != NULL && inode->chunks[i].idx == idx) {
+      return &inode->chunks[i];
+    }
+  }
+  struct chunk_buf *buf = &inode->chunks[inode->next_chunk];
+  if (buf->data == NULL) {
+    buf->data = malloc(CHUNK_SIZE);
+    if (buf->data == NULL) {
+      return NULL;
+    }
+  } else if (buf->dirty && !store_chunk(inode, buf)) {
+    return NULL;
+  }
+  inode->next_chunk = (inode->next_chunk + 1) % CHUNK_BUFS;
+  return load_chunk(inode, buf, idx) ? buf : NULL;
+}
+
+/* Copies up to SIZE bytes at OFFSET between BUFFER and compressed
+   INODE, which is LENGTH bytes long, by way of its chunk buffers.
+   Returns the number of bytes copied. */
+static off_t copy_compressed(struct inode *inode, uint8_t *buffer, off_t size,
+                             off_t offset, off_t length, bool write) {
+  ASSERT(lock_held_by_current_thread(&inode->lock));
+  off_t bytes_done = 0;
+  while (size > 0 && offset < length) {
+    int chunk_ofs = offset % CHUNK_SIZE;
+    off_t chunk_size = CHUNK_SIZE - chunk_ofs;
+    if (chunk_size > length - offset) {
+      chunk_size = length - offset;
+    }
+    if (chunk_size > size) {
+      chunk_size = size;
+    }
+    struct chunk_buf *buf = get_chunk(inode, offset / CHUNK_SIZE);
+    if (buf == NULL) {
+      break;
+    }
+    if (write) {
+      memcpy(buf->data + chunk_ofs, buffer + bytes_done, chunk_size);
+      buf->dirty = true;
+    } else {
+      memcpy(buffer + bytes_done, buf->data + chunk_ofs, chunk_size);
+    }
+    size -= chunk_size;
+    offset += chunk_size;
+    bytes_done += chunk_size;
+  }
+  return bytes_done;
+}
+
+/* Makes the first LENGTH bytes of INODE visible to readers and
+   writes the on-disk inode back through the cache. */
+static void publish_length(struct inode *inode, off_t length) {
+  ASSERT(lock_held_by_current_thread(&inode->extend_lock));
+  lock_acquire(&inode->lock);
+  if (length > inode->length) {
+    inode->length = length;
+  }
+  cache_write(inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+  lock_release(&inode->lock);
+}
+
+/* Registers a read or write of INODE's blocks, waiting first for
+   any relocation of them to finish. */
+static void begin_io(struct inode *inode) {
   ASSERT(lock_held_by_current_thread(&inode->lock));
-  return extend_disk(&inode->data, pos);
+  while (inode->relocating) {
+    cond_wait(&inode->io_idle, &inode->lock);
+  }
+  inode->io_cnt++;
+}
+
+/* Ends a read or write registered by begin_io(). */
+static void end_io(struct inode *inode) {
+  lock_acquire(&inode->lock);
+  if (--inode->io_cnt == 0) {
+    cond_broadcast(&inode->io_idle, &inode->lock);
+  }
+  lock_release(&inode->lock);
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is marked as a directory if IS_DIR.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
 
@@ -178,12 +818,13 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
+      fsck_mark_dirty (sector);
       disk_inode->length = 0;
       disk_inode->magic = INODE_MAGIC;
-      if (extend_disk(disk_inode, length) < length) {
-        for (off_t ofs = 0; ofs < disk_inode->length; ofs += BLOCK_SECTOR_SIZE){
-          free_map_release(byte_to_sector_disk(disk_inode, ofs));
-        }
+      disk_inode->flags = is_dir ? INODE_DIR : 0;
+      if (extend_disk(disk_inode, NULL, length) < length) {
+        release_blocks(disk_inode);
+        free(disk_inode);
         return false;
       }
       cache_write(sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
@@ -203,6 +844,7 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
@@ -210,6 +852,7 @@ inode_open (block_sector_t sector)
       if (inode->sector == sector) 
         {
           inode_reopen (inode);
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -217,7 +860,10 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -226,7 +872,25 @@ inode_open (block_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init(&inode->lock);
+  lock_init(&inode->extend_lock);
+  lock_init(&inode->dir_lock);
+  lock_init(&inode->map.lock);
+  memset(inode->map.indirect, 0, sizeof inode->map.indirect);
+  inode->delayed = NULL;
+  inode->delayed_cnt = 0;
+  inode->io_cnt = 0;
+  inode->relocating = false;
+  cond_init(&inode->io_idle);
+  for (int i = 0; i < CHUNK_BUFS; i++)
+    {
+      inode->chunks[i].idx = -1;
+      inode->chunks[i].dirty = false;
+      inode->chunks[i].data = NULL;
+    }
+  inode->next_chunk = 0;
   cache_read(inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+  inode->length = inode->data.length;
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -249,6 +913,48 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
+/* Returns true if INODE has been removed but is still open. */
+bool
+inode_is_removed (struct inode *inode)
+{
+  lock_acquire(&inode->lock);
+  bool removed = inode->removed;
+  lock_release(&inode->lock);
+  return removed;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (struct inode *inode)
+{
+  lock_acquire(&inode->lock);
+  int open_cnt = inode->open_cnt;
+  lock_release(&inode->lock);
+  return open_cnt;
+}
+
+/* Acquires the lock that serializes operations on the directory
+   stored in INODE. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire(&inode->dir_lock);
+}
+
+/* Releases the lock taken by inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release(&inode->dir_lock);
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -260,25 +966,49 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire(&open_inodes_lock);
   lock_acquire(&inode->lock);
   if (--inode->open_cnt == 0)
     {
+      lock_release(&inode->lock);
+
+      /* Place delayed sectors and chunks on disk before forgetting
+         about them, while INODE is still in the list: an inode_open
+         of the same sector waits meanwhile and then reads the real
+         block pointers, instead of building a second inode from the
+         stale ones on disk.  No one else holds INODE, so its
+         extend_lock is free. */
+      if (!inode->removed)
+        {
+          lock_acquire(&inode->extend_lock);
+          flush_delayed(inode);
+          lock_acquire(&inode->lock);
+          store_chunks(inode);
+          lock_release(&inode->lock);
+          lock_release(&inode->extend_lock);
+        }
+
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      lock_release(&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          fsck_mark_dirty (inode->sector);
           free_map_release (inode->sector);
-          for(off_t ofs = 0; ofs < inode->data.length; ofs += BLOCK_SECTOR_SIZE){
-            free_map_release(byte_to_sector(inode, ofs));
-          }
+          release_blocks(&inode->data);
         }
 
-      lock_release(&inode->lock);
+      free_map_unreserve(inode->delayed_cnt);
+      free(inode->delayed);
+      for (int i = 0; i < CHUNK_BUFS; i++)
+        free(inode->chunks[i].data);
+      block_map_free(&inode->map);
       free (inode); 
     } else {
       lock_release(&inode->lock);
+      lock_release(&open_inodes_lock);
     }
 }
 
@@ -293,93 +1023,508 @@ inode_remove (struct inode *inode)
   lock_release(&inode->lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Copies SIZE bytes at OFFSET between BUFFER and INODE's blocks,
+   stopping at LENGTH, which is writing to INODE if WRITE.  The
+   caller must keep relocation away.  Returns the number of bytes
+   copied. */
+static off_t
+transfer_blocks (struct inode *inode, uint8_t *buffer, off_t size,
+                 off_t offset, off_t length, bool write)
 {
-  uint8_t *buffer = buffer_;
-  off_t bytes_read = 0;
+  off_t bytes_done = 0;
 
-  lock_acquire(&inode->lock);
-  while (size > 0 && offset < inode->data.length) 
+  while (size > 0 && offset < length) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      ASSERT(sector_idx != (block_sector_t) -1);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode->data.length - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
-      /* Number of bytes to actually copy out of this sector. */
+      /* Number of bytes to actually copy in this sector. */
       int chunk_size = size < min_left ? size : min_left;
-
       if (chunk_size <= 0)
         break;
 
-      cache_read(sector_idx, buffer+bytes_read, chunk_size, sector_ofs);
-      
+      if (!copy_delayed(inode, buffer + bytes_done, chunk_size, offset, write))
+        {
+          block_sector_t sector_idx = byte_to_sector (inode, offset);
+          ASSERT(sector_idx != (block_sector_t) -1);
+          if (write)
+            cache_write(sector_idx, buffer + bytes_done, chunk_size,
+                        sector_ofs);
+          else
+            cache_read(sector_idx, buffer + bytes_done, chunk_size,
+                       sector_ofs);
+        }
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
-      bytes_read += chunk_size;
+      bytes_done += chunk_size;
     }
-  
+  return bytes_done;
+}
+
+/* Copies between the CNT buffers of IOV, in turn, and INODE starting
+   at OFFSET, which is LENGTH bytes long.  Inline and compressed
+   data must be accessed with INODE's lock held.  Stops at the first buffer that
+   cannot be copied in full.  Returns the number of bytes copied. */
+static off_t
+transfer_vec (struct inode *inode, const struct iovec *iov, int cnt,
+              off_t offset, off_t length, bool write)
+{
+  off_t total = 0;
+
+  for (int i = 0; i < cnt; i++)
+    {
+      off_t size = iov[i].iov_len;
+      off_t done;
+      if (is_compressed (&inode->data))
+        done = copy_compressed (inode, iov[i].iov_base, size, offset, length,
+                                write);
+      else if (is_inline (&inode->data))
+        done = copy_inline (inode, iov[i].iov_base, size, offset, length,
+                            write);
+      else
+        done = transfer_blocks (inode, iov[i].iov_base, size, offset, length,
+                                write);
+      total += done;
+      offset += done;
+      if (done < size)
+        break;
+    }
+  return total;
+}
+
+/* Reads from INODE into the CNT buffers of IOV, in turn, starting
+   at position OFFSET.  The whole vector is one read, against a
+   single snapshot of INODE's length.
+   Returns the number of bytes actually read, which may be less
+   than requested if an error occurs or end of file is reached.
+   Reads only hold INODE's lock long enough to snapshot its length,
+   or to copy out inline or compressed data, so any number of them may run at once,
+   alongside writes. */
+off_t
+inode_readv (struct inode *inode, const struct iovec *iov, int cnt,
+             off_t offset)
+{
+  off_t bytes_read;
+
+  if (offset < 0)
+    return 0;
+
+  lock_acquire(&inode->lock);
+  if (needs_lock(&inode->data)) {
+    bytes_read = transfer_vec(inode, iov, cnt, offset, inode->length, false);
+    lock_release(&inode->lock);
+    return bytes_read;
+  }
+  begin_io(inode);
+  off_t length = inode->length;
   lock_release(&inode->lock);
+
+  bytes_read = transfer_vec(inode, iov, cnt, offset, length, false);
+  end_io(inode);
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  struct iovec iov = { buffer, size };
+  return inode_readv (inode, &iov, 1, offset);
+}
+
+/* Writes the CNT buffers of IOV, in turn, into INODE, starting at
+   OFFSET.  The whole vector is one write: it extends INODE at most
+   once.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than requested if end of file is reached or an error occurs.
+   Writes that stay within the file run concurrently with reads and
+   with each other.  Writes past end of file extend the inode and
+   are serialized on its extend_lock; the new length only becomes
+   visible to readers once the data has been written. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+inode_writev (struct inode *inode, const struct iovec *iov, int cnt,
+              off_t offset)
 {
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
+  off_t size = 0;
+  off_t bytes_written;
+
+  for (int i = 0; i < cnt; i++)
+    size += iov[i].iov_len;
+
+  /* A negative OFFSET, or one that SIZE carries past the largest
+     off_t, would pass the length checks below. */
+  if (offset < 0 || size < 0 || size > INT32_MAX - offset)
+    return 0;
+
+  /* Directory entries are metadata too. */
+  if (inode_is_dir (inode))
+    fsck_mark_dirty (inode->sector);
 
   lock_acquire(&inode->lock);
   if (inode->deny_write_cnt) {
     lock_release(&inode->lock);
     return 0;
   }
+  off_t length = inode->length;
+  if (offset + size <= length) {
+    if (needs_lock(&inode->data)) {
+      bytes_written = transfer_vec(inode, iov, cnt, offset, length, true);
+      lock_release(&inode->lock);
+    } else {
+      begin_io(inode);
+      lock_release(&inode->lock);
+      bytes_written = transfer_vec(inode, iov, cnt, offset, length, true);
+      end_io(inode);
+    }
+    return bytes_written;
+  }
+  lock_release(&inode->lock);
 
-  extend(inode, offset + size);
+  /* Relocation also takes the extend_lock, so it cannot run while
+     this write holds it. */
+  lock_acquire(&inode->extend_lock);
+  length = extend(inode, offset + size);
+  lock_acquire(&inode->lock);
+  if (needs_lock(&inode->data)) {
+    bytes_written = transfer_vec(inode, iov, cnt, offset, length, true);
+    lock_release(&inode->lock);
+  } else {
+    lock_release(&inode->lock);
+    bytes_written = transfer_vec(inode, iov, cnt, offset, length, true);
+  }
+  publish_length(inode, length);
+  lock_release(&inode->extend_lock);
+  return bytes_written;
+}
 
-  while (size > 0 && offset < inode->data.length) 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if end of file is reached or an error occurs. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  struct iovec iov = { (void *) buffer, size };
+  return inode_writev (inode, &iov, 1, offset);
+}
+
+/* Asks the buffer cache to read ahead the sectors holding SIZE bytes
+   of INODE starting at OFFSET, without waiting for them to arrive. */
+void
+inode_prefetch (struct inode *inode, off_t size, off_t offset)
+{
+  lock_acquire(&inode->lock);
+  off_t length = inode->data.length;
+  bool locked = needs_lock(&inode->data);
+  lock_release(&inode->lock);
+  if (locked)
+    return;
+
+  /* Delayed sectors are already in memory. */
+  off_t end = offset + size < length ? offset + size : length;
+  for (off_t ofs = ROUND_DOWN(offset, BLOCK_SECTOR_SIZE); ofs < end;
+       ofs += BLOCK_SECTOR_SIZE)
+    cache_prefetch(byte_to_sector(inode, ofs));
+}
+
+/* Reopens and returns the open regular file with the lowest sector
+   number above SECTOR, or a null pointer if there is none.  Lets a
+   caller visit every open file without holding the list lock
+   throughout.  Directories are skipped: dir_remove() takes any other
+   opener of a directory for a user of it, so holding one here would
+   make removing it fail. */
+struct inode *
+inode_open_next (block_sector_t sector)
+{
+  struct list_elem *e;
+  struct inode *next = NULL;
+
+  lock_acquire (&open_inodes_lock);
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      ASSERT(sector_idx != (block_sector_t) -1);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector > sector && !inode_is_dir (inode)
+          && (next == NULL || inode->sector < next->sector))
+        next = inode;
+    }
+  inode_reopen (next);
+  lock_release (&open_inodes_lock);
+  return next;
+}
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode->data.length - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+/* Moves the data blocks of INODE into one contiguous run, if they
+   are not in one already and INODE has at most MAX_SECTORS of them.
+   Reads and writes of INODE wait while the blocks are copied, and
+   the direct and indirect pointers then change over together.
+   Returns the number of sectors moved. */
+int
+inode_defragment (struct inode *inode, int max_sectors)
+{
+  lock_acquire (&inode->extend_lock);
+  flush_delayed (inode);
+  int cnt = bytes_to_sectors (inode->data.length);
+  if (needs_lock (&inode->data) || inode_is_removed (inode)
+      || inode->delayed_cnt > 0 || cnt > max_sectors)
+    {
+      lock_release (&inode->extend_lock);
+      return 0;
+    }
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
-      
-      cache_write(sector_idx, buffer + bytes_written, chunk_size, sector_ofs);
+  /* Count the breaks between consecutive blocks. */
+  block_sector_t *old = malloc (cnt * sizeof *old);
+  uint8_t *buffer = malloc (BLOCK_SECTOR_SIZE);
+  int breaks = 0;
+  for (int i = 0; old != NULL && i < cnt; i++)
+    {
+      old[i] = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE);
+      if (i > 0 && old[i] != old[i - 1] + 1)
+        breaks++;
+    }
+  block_sector_t first;
+  if (old != NULL && breaks > 0)
+    fsck_mark_dirty (inode->sector);
+  if (old == NULL || buffer == NULL || breaks == 0
+      || !free_map_allocate_run (cnt, &first))
+    {
+      free (old);
+      free (buffer);
+      lock_release (&inode->extend_lock);
+      return 0;
+    }
+  if (first + cnt - 1 > UINT16_MAX)
+    {
+      for (int i = 0; i < cnt; i++)
+        free_map_release (first + i);
+      free (old);
+      free (buffer);
+      lock_release (&inode->extend_lock);
+      return 0;
+    }
 
-      /* Advance. */
-      size -= chunk_size;
-      offset += chunk_size;
-      bytes_written += chunk_size;
+  /* Hold off readers and writers until the move is done. */
+  lock_acquire (&inode->lock);
+  inode->relocating = true;
+  while (inode->io_cnt > 0)
+    cond_wait (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
+
+  for (int i = 0; i < cnt; i++)
+    {
+      cache_read (old[i], buffer, BLOCK_SECTOR_SIZE, 0);
+      cache_write (first + i, buffer, BLOCK_SECTOR_SIZE, 0);
     }
 
-  lock_release(&inode->lock);
-  return bytes_written;
+  /* Repoint the inode, one whole indirect block at a time. */
+  lock_acquire (&inode->map.lock);
+  for (int i = 0; i < cnt && i < NUM_DIRECT; i++)
+    inode->data.direct[i] = first + i;
+  for (int ind_idx = 0; NUM_DIRECT + ind_idx * INDIRECT_LEN < cnt; ind_idx++)
+    {
+      uint16_t *block = (uint16_t *) buffer;
+      memset (block, 0, BLOCK_SECTOR_SIZE);
+      for (int j = 0; j < INDIRECT_LEN; j++)
+        {
+          int idx = NUM_DIRECT + ind_idx * INDIRECT_LEN + j;
+          if (idx >= cnt)
+            break;
+          block[j] = first + idx;
+        }
+      cache_write (inode->data.indirect[ind_idx], block, BLOCK_SECTOR_SIZE, 0);
+      if (inode->map.indirect[ind_idx] != NULL)
+        memcpy (inode->map.indirect[ind_idx], block, BLOCK_SECTOR_SIZE);
+    }
+  lock_release (&inode->map.lock);
+  cache_write (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+
+  for (int i = 0; i < cnt; i++)
+    free_map_release (old[i]);
+
+  lock_acquire (&inode->lock);
+  inode->relocating = false;
+  cond_broadcast (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
+  lock_release (&inode->extend_lock);
+  free (old);
+  free (buffer);
+  return cnt;
+}
+
+/* Gives places on disk to the delayed sectors of every open inode
+   that is not being extended right now, and compresses the changed
+   chunks of compressed ones, so that the next cache_save() writes
+   them out. */
+void
+inode_flush_delayed (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&open_inodes_lock);
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (is_compressed (&inode->data))
+        {
+          lock_acquire (&inode->lock);
+          store_chunks (inode);
+          lock_release (&inode->lock);
+        }
+      else if (inode->delayed_cnt > 0
+               && lock_try_acquire (&inode->extend_lock))
+        {
+          flush_delayed (inode);
+          lock_release (&inode->extend_lock);
+        }
+    }
+  lock_release (&open_inodes_lock);
+}
+
+/* Makes INODE store its data compressed from now on.  Only empty
+   regular files can be switched.  Returns true if successful. */
+bool
+inode_set_compressed (struct inode *inode)
+{
+  lock_acquire (&inode->extend_lock);
+  lock_acquire (&inode->lock);
+  bool success = inode->length == 0 && !inode_is_dir (inode);
+  if (success)
+    {
+      fsck_mark_dirty (inode->sector);
+      inode->data.flags |= INODE_COMPRESSED;
+      cache_write (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+    }
+  lock_release (&inode->lock);
+  lock_release (&inode->extend_lock);
+  return success;
+}
+
+/* Checks the on-disk inode in SECTOR, for fsck.  Returns false if
+   SECTOR does not hold an inode.  Otherwise stores whether it is a
+   directory in *IS_DIR, if IS_DIR is nonnull, and returns true.
+
+   If CLAIMED is nonnull, also checks the inode's indirect and data
+   blocks against it and marks them in it.  A block that is out of
+   range or already marked cuts the file short just before the
+   sector it holds, or, in a compressed file, before the chunk that
+   sector belongs to.  The inode must not be open. */
+bool
+inode_check (block_sector_t sector, struct bitmap *claimed, bool *is_dir)
+{
+  struct inode_disk *disk = malloc (sizeof *disk);
+  uint16_t *block = malloc (BLOCK_SECTOR_SIZE);
+  uint16_t *slots = NULL;
+  bool valid = false;
+
+  if (disk == NULL || block == NULL)
+    PANIC ("fsck: out of memory");
+  cache_read (sector, disk, BLOCK_SECTOR_SIZE, 0);
+  if (disk->magic != INODE_MAGIC || disk->length < 0
+      || disk->length > MAX_INODE_LEN
+      || (disk->flags & ~(INODE_DIR | INODE_COMPRESSED)) != 0)
+    goto done;
+  valid = true;
+  if (is_dir != NULL)
+    *is_dir = (disk->flags & INODE_DIR) != 0;
+  if (claimed == NULL || is_inline (disk))
+    goto done;
+
+  /* Gather every block pointer first, claiming the indirect blocks
+     on the way, so that a cut can give back the blocks of a partly
+     claimed chunk. */
+  bool compressed = is_compressed (disk);
+  int cnt = bytes_to_sectors (disk->length);
+  if (compressed)
+    cnt = ROUND_UP (cnt, CHUNK_SECTORS);
+  int ind_cnt = cnt > NUM_DIRECT
+                ? DIV_ROUND_UP (cnt - NUM_DIRECT, INDIRECT_LEN) : 0;
+  slots = calloc (cnt, sizeof *slots);
+  if (slots == NULL)
+    PANIC ("fsck: out of memory");
+  for (int i = 0; i < cnt && i < NUM_DIRECT; i++)
+    slots[i] = disk->direct[i];
+
+  size_t limit = bitmap_size (claimed);
+  int cut = cnt;
+  int ind_ok;                   /* Indirect blocks claimed. */
+  for (ind_ok = 0; ind_ok < ind_cnt; ind_ok++)
+    {
+      int first = NUM_DIRECT + ind_ok * INDIRECT_LEN;
+      block_sector_t ind = disk->indirect[ind_ok];
+      if (ind == 0 && compressed)
+        continue;
+      if (ind == 0 || ind >= limit || bitmap_test (claimed, ind))
+        {
+          cut = compressed ? ROUND_DOWN (first, CHUNK_SECTORS) : first;
+          break;
+        }
+      bitmap_mark (claimed, ind);
+      cache_read (ind, block, BLOCK_SECTOR_SIZE, 0);
+      for (int j = 0; j < INDIRECT_LEN && first + j < cnt; j++)
+        slots[first + j] = block[j];
+    }
+
+  /* Claim data blocks up to the first bad one. */
+  for (int i = 0; i < cut; i++)
+    {
+      if (slots[i] == 0 && compressed)
+        continue;
+      if (slots[i] == 0 || slots[i] >= limit
+          || bitmap_test (claimed, slots[i]))
+        {
+          cut = compressed ? ROUND_DOWN (i, CHUNK_SECTORS) : i;
+          for (int j = cut; j < i; j++)
+            if (slots[j] != 0)
+              bitmap_reset (claimed, slots[j]);
+          break;
+        }
+      bitmap_mark (claimed, slots[i]);
+    }
+  if (cut == cnt)
+    goto done;
+
+  /* Cut the file short.  A compressed file reads its slots whatever
+     its length, so the ones past the cut are cleared.  Indirect
+     blocks wholly past it are given up. */
+  printf ("fsck: inode %"PRDSNu": bad block %d of %d, truncated\n",
+          sector, cut, cnt);
+  disk->length = cut * BLOCK_SECTOR_SIZE;
+  for (int i = cut; i < NUM_DIRECT; i++)
+    disk->direct[i] = 0;
+  for (int ind_idx = 0; ind_idx < NUM_INDIRECT; ind_idx++)
+    {
+      int first = NUM_DIRECT + ind_idx * INDIRECT_LEN;
+      block_sector_t ind = disk->indirect[ind_idx];
+      if (ind == 0 || first + INDIRECT_LEN <= cut)
+        continue;
+      if (ind_idx >= ind_ok || first >= cut)
+        {
+          if (ind_idx < ind_ok)
+            bitmap_reset (claimed, ind);
+          disk->indirect[ind_idx] = 0;
+          continue;
+        }
+      cache_read (ind, block, BLOCK_SECTOR_SIZE, 0);
+      memset (block + (cut - first), 0,
+              (INDIRECT_LEN - (cut - first)) * sizeof *block);
+      cache_write (ind, block, BLOCK_SECTOR_SIZE, 0);
+    }
+  cache_write (sector, disk, BLOCK_SECTOR_SIZE, 0);
+
+ done:
+  free (slots);
+  free (block);
+  free (disk);
+  return valid;
 }
 
 /* Disables writes to INODE.
@@ -411,7 +1556,7 @@ off_t
 inode_length (struct inode *inode)
 {
   lock_acquire(&inode->lock);
-  off_t length = inode->data.length;
+  off_t length = inode->length;
   lock_release(&inode->lock);
   return length;
 }
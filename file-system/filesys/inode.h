@@ -6,16 +6,32 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct iovec;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (struct inode *);
+int inode_open_cnt (struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv (struct inode *, const struct iovec *, int cnt,
+                   off_t offset);
+off_t inode_writev (struct inode *, const struct iovec *, int cnt,
+                    off_t offset);
+void inode_prefetch (struct inode *, off_t size, off_t offset);
+void inode_flush_delayed (void);
+struct inode *inode_open_next (block_sector_t);
+int inode_defragment (struct inode *, int max_sectors);
+bool inode_set_compressed (struct inode *);
+bool inode_check (block_sector_t, struct bitmap *claimed, bool *is_dir);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (struct inode *);
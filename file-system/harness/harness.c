@@ -0,0 +1,586 @@
+/* harness.c
+
+   Runs the file system's cache, inode, free map and file layers
+   as an ordinary host program, on a simulated block device, so
+   that they can be tested, benchmarked and profiled without
+   booting a kernel.  The rest of the kernel is replaced by the
+   stand-ins in stubs.c and include/.
+
+   Usage: harness [-d SECTORS | -f IMAGE] [-l USECS] [-T] [-q]
+                  {-b BENCH | TRACE}
+
+   -d SECTORS  Format a fresh device of SECTORS sectors held in
+               memory (the default, with 16384 sectors).
+   -f IMAGE    Use the file system in IMAGE, such as one built by
+               pintos-mkfs, and write it back at the end.  Inodes
+               the harness creates are in no directory, so
+               pintos-fsck reports their sectors as leaked.
+   -l USECS    Make each device access take USECS microseconds.
+   -T          Start no background threads, for runs that must be
+               repeatable.
+   -q          Do not report short writes and bad reads one by one.
+   -b BENCH    Run benchmark BENCH: seq, rand or small.
+   TRACE       Replay the operations in file TRACE ("-" for the
+               standard input), one per line:
+
+                 c ID LENGTH      create inode ID, LENGTH bytes long
+                 w ID OFS SIZE    write SIZE bytes at OFS
+                 r ID OFS SIZE    read SIZE bytes at OFS
+                 d ID             remove inode ID
+                 s                flush everything to the device
+                 # ...            comment
+
+               IDs run from 0 to MAX_IDS - 1 and are the harness's
+               own names for inodes, not sectors.
+
+   Every byte read is compared against a copy of what was written,
+   so a trace is also a test: the exit status is 1 if any read
+   returned the wrong data, 0 otherwise.  Each run ends with the
+   number of operations per second and the device reads and
+   writes that they took.
+
+   Build, from this directory:
+
+     cc -O2 -pthread -D__off_t_defined -Iinclude -I.. -I../../virtual-memory/lib \
+        -o harness harness.c stubs.c ../filesys/cache.c ../filesys/inode.c \
+        ../filesys/free-map.c ../filesys/file.c ../filesys/compress.c */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <debug.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "harness.h"
+
+/* Largest inode ID a trace may use. */
+#define MAX_IDS 1024
+
+/* Simulated block device. */
+struct block
+  {
+    uint8_t *data;              /* Contents, SIZE sectors. */
+    block_sector_t size;        /* Size in sectors. */
+    const char *image;          /* File to save DATA to, or null. */
+    unsigned delay;             /* Microseconds per access. */
+    uint64_t reads;             /* Sectors read. */
+    uint64_t writes;            /* Sectors written. */
+  };
+
+struct block *fs_device;
+
+/* An inode the harness has created, with a copy of its contents
+   to check reads against. */
+struct file_state
+  {
+    struct inode *inode;        /* Open inode, or null. */
+    uint8_t *shadow;            /* Expected contents. */
+    off_t length;               /* Expected length. */
+  };
+
+static struct file_state files[MAX_IDS];
+static unsigned write_gen;      /* Varies the data written. */
+static long mismatches;         /* Reads that returned wrong data. */
+static bool quiet;
+
+static void usage (void) NO_RETURN;
+static void fail (const char *, ...) NO_RETURN PRINTF_FORMAT (1, 2);
+
+static void
+fail (const char *format, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "harness: ");
+  va_start (args, format);
+  vfprintf (stderr, format, args);
+  va_end (args);
+  putc ('\n', stderr);
+  exit (2);
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "usage: harness [-d SECTORS | -f IMAGE] [-l USECS] [-T] [-q]\n"
+           "               {-b seq|rand|small | TRACE}\n");
+  exit (2);
+}
+
+/* Simulated block device. */
+
+/* Creates a device of SECTORS zeroed sectors or, if IMAGE is
+   nonnull, one holding the contents of file IMAGE. */
+struct block *
+sim_block_create (block_sector_t sectors, const char *image)
+{
+  struct block *block = calloc (1, sizeof *block);
+  if (block == NULL)
+    fail ("out of memory");
+  if (image != NULL)
+    {
+      FILE *f = fopen (image, "rb");
+      long size;
+      if (f == NULL || fseek (f, 0, SEEK_END) != 0 || (size = ftell (f)) < 0)
+        fail ("%s: %s", image, strerror (errno));
+      if (size % BLOCK_SECTOR_SIZE != 0 || size == 0)
+        fail ("%s: size is not a positive multiple of %d",
+              image, BLOCK_SECTOR_SIZE);
+      sectors = size / BLOCK_SECTOR_SIZE;
+      rewind (f);
+      block->data = malloc (size);
+      if (block->data == NULL)
+        fail ("out of memory");
+      if (fread (block->data, 1, size, f) != (size_t) size)
+        fail ("%s: read error", image);
+      fclose (f);
+    }
+  else
+    {
+      block->data = calloc (sectors, BLOCK_SECTOR_SIZE);
+      if (block->data == NULL)
+        fail ("out of memory");
+    }
+  block->size = sectors;
+  block->image = image;
+  return block;
+}
+
+/* Writes BLOCK back to the image it was loaded from, if any. */
+void
+sim_block_save (struct block *block)
+{
+  FILE *f;
+
+  if (block->image == NULL)
+    return;
+  f = fopen (block->image, "r+b");
+  if (f == NULL
+      || fwrite (block->data, BLOCK_SECTOR_SIZE, block->size, f) != block->size
+      || fclose (f) != 0)
+    fail ("%s: write error", block->image);
+}
+
+/* Returns the number of sectors read from and written to BLOCK. */
+void
+sim_block_stats (struct block *block, uint64_t *reads, uint64_t *writes)
+{
+  *reads = __atomic_load_n (&block->reads, __ATOMIC_RELAXED);
+  *writes = __atomic_load_n (&block->writes, __ATOMIC_RELAXED);
+}
+
+static void
+check_sector (struct block *block, block_sector_t sector)
+{
+  if (sector >= block->size)
+    PANIC ("Access past end of device (sector=%"PRDSNu", size=%"PRDSNu")",
+           sector, block->size);
+}
+
+static void
+access_delay (struct block *block)
+{
+  if (block->delay > 0)
+    usleep (block->delay);
+}
+
+void
+block_read (struct block *block, block_sector_t sector, void *buffer)
+{
+  check_sector (block, sector);
+  access_delay (block);
+  memcpy (buffer, block->data + (size_t) sector * BLOCK_SECTOR_SIZE,
+          BLOCK_SECTOR_SIZE);
+  __atomic_fetch_add (&block->reads, 1, __ATOMIC_RELAXED);
+}
+
+void
+block_write (struct block *block, block_sector_t sector, const void *buffer)
+{
+  check_sector (block, sector);
+  access_delay (block);
+  memcpy (block->data + (size_t) sector * BLOCK_SECTOR_SIZE, buffer,
+          BLOCK_SECTOR_SIZE);
+  __atomic_fetch_add (&block->writes, 1, __ATOMIC_RELAXED);
+}
+
+block_sector_t
+block_size (struct block *block)
+{
+  return block->size;
+}
+
+/* Operations, shared by traces and benchmarks. */
+
+static struct file_state *
+get_file (int id, bool open)
+{
+  if (id < 0 || id >= MAX_IDS)
+    fail ("inode ID %d out of range", id);
+  if ((files[id].inode != NULL) != open)
+    fail ("inode %d is %s", id, open ? "not open" : "already open");
+  return &files[id];
+}
+
+/* Grows F's copy to LENGTH bytes, zero-filled as the inode's is. */
+static void
+grow_shadow (struct file_state *f, off_t length)
+{
+  if (length <= f->length)
+    return;
+  f->shadow = realloc (f->shadow, length);
+  if (f->shadow == NULL)
+    fail ("out of memory");
+  memset (f->shadow + f->length, 0, length - f->length);
+  f->length = length;
+}
+
+/* Creates inode ID with LENGTH bytes.  Returns false if the disk
+   is full. */
+static bool
+op_create (int id, off_t length)
+{
+  struct file_state *f = get_file (id, false);
+  block_sector_t sector = 0;
+
+  if (!free_map_allocate (&sector))
+    return false;
+  if (!inode_create (sector, length, false))
+    {
+      free_map_release (sector);
+      return false;
+    }
+  f->inode = inode_open (sector);
+  if (f->inode == NULL)
+    fail ("can't open inode %"PRDSNu, sector);
+  f->length = 0;
+  grow_shadow (f, length);
+  return true;
+}
+
+/* Writes SIZE bytes at OFS in inode ID.  Returns the number of
+   bytes written, which is less than SIZE if the disk fills up. */
+static off_t
+op_write (int id, off_t ofs, off_t size, uint8_t *buffer)
+{
+  struct file_state *f = get_file (id, true);
+  off_t written;
+  off_t i;
+
+  write_gen++;
+  for (i = 0; i < size; i++)
+    buffer[i] = (ofs + i) * 31 + id + write_gen;
+  written = inode_write_at (f->inode, buffer, size, ofs);
+  if (written > 0)
+    {
+      grow_shadow (f, ofs + written);
+      memcpy (f->shadow + ofs, buffer, written);
+    }
+  return written;
+}
+
+/* Reads SIZE bytes at OFS in inode ID and checks them.  Returns
+   the number of bytes read. */
+static off_t
+op_read (int id, off_t ofs, off_t size, uint8_t *buffer)
+{
+  struct file_state *f = get_file (id, true);
+  off_t expected = ofs < f->length ? f->length - ofs : 0;
+  off_t got;
+
+  if (expected > size)
+    expected = size;
+  got = inode_read_at (f->inode, buffer, size, ofs);
+  if (got != expected || memcmp (buffer, f->shadow + ofs, got) != 0)
+    {
+      if (mismatches++ < 10 && !quiet)
+        printf ("inode %d: read of %"PRId32" bytes at %"PRId32" "
+                "returned wrong data\n", id, size, ofs);
+    }
+  return got;
+}
+
+/* Removes inode ID. */
+static void
+op_delete (int id)
+{
+  struct file_state *f = get_file (id, true);
+
+  inode_remove (f->inode);
+  inode_close (f->inode);
+  f->inode = NULL;
+  free (f->shadow);
+  f->shadow = NULL;
+  f->length = 0;
+}
+
+/* Writes everything cached out to the device. */
+static void
+op_sync (void)
+{
+  inode_flush_delayed ();
+  cache_save ();
+}
+
+/* Returns a buffer big enough for SIZE bytes. */
+static uint8_t *
+get_buffer (off_t size)
+{
+  static uint8_t *buffer;
+  static off_t buffer_size;
+
+  if (size > buffer_size)
+    {
+      buffer = realloc (buffer, size);
+      if (buffer == NULL)
+        fail ("out of memory");
+      buffer_size = size;
+    }
+  return buffer;
+}
+
+/* Timing. */
+
+struct phase
+  {
+    const char *name;
+    struct timespec start;
+    uint64_t reads, writes;
+    long ops;
+  };
+
+static void
+phase_begin (struct phase *p, const char *name)
+{
+  p->name = name;
+  p->ops = 0;
+  sim_block_stats (fs_device, &p->reads, &p->writes);
+  clock_gettime (CLOCK_MONOTONIC, &p->start);
+}
+
+static void
+phase_end (struct phase *p)
+{
+  struct timespec end;
+  uint64_t reads, writes;
+  double secs;
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  sim_block_stats (fs_device, &reads, &writes);
+  secs = (end.tv_sec - p->start.tv_sec)
+         + (end.tv_nsec - p->start.tv_nsec) / 1e9;
+  printf ("%-12s %8ld ops %9.3f s %12.0f ops/s %8"PRIu64" reads "
+          "%8"PRIu64" writes\n", p->name, p->ops, secs,
+          secs > 0 ? p->ops / secs : 0.0,
+          reads - p->reads, writes - p->writes);
+}
+
+/* Traces. */
+
+static void
+run_trace (const char *name)
+{
+  FILE *f = strcmp (name, "-") ? fopen (name, "r") : stdin;
+  struct phase phase;
+  char line[256];
+  int line_nr = 0;
+
+  if (f == NULL)
+    fail ("%s: %s", name, strerror (errno));
+  phase_begin (&phase, "trace");
+  while (fgets (line, sizeof line, f) != NULL)
+    {
+      int id;
+      long a, b;
+      char op;
+
+      line_nr++;
+      if (sscanf (line, " %c", &op) != 1 || op == '#')
+        continue;
+      if (op == 'c' && sscanf (line, " c %d %ld", &id, &a) == 2 && a >= 0)
+        {
+          if (!op_create (id, a))
+            printf ("%s:%d: disk full\n", name, line_nr);
+        }
+      else if (op == 'w' && sscanf (line, " w %d %ld %ld", &id, &a, &b) == 3
+               && a >= 0 && b >= 0)
+        {
+          if (op_write (id, a, b, get_buffer (b)) != b && !quiet)
+            printf ("%s:%d: short write\n", name, line_nr);
+        }
+      else if (op == 'r' && sscanf (line, " r %d %ld %ld", &id, &a, &b) == 3
+               && a >= 0 && b >= 0)
+        op_read (id, a, b, get_buffer (b));
+      else if (op == 'd' && sscanf (line, " d %d", &id) == 1)
+        op_delete (id);
+      else if (op == 's')
+        op_sync ();
+      else
+        fail ("%s:%d: bad operation", name, line_nr);
+      phase.ops++;
+    }
+  if (f != stdin)
+    fclose (f);
+  phase_end (&phase);
+}
+
+/* Benchmarks. */
+
+/* Sequential 4 kB writes and then reads of a file a quarter the
+   size of the disk. */
+static void
+bench_seq (void)
+{
+  off_t size = block_size (fs_device) / 4 * BLOCK_SECTOR_SIZE;
+  uint8_t *buffer = get_buffer (4096);
+  struct phase phase;
+  off_t ofs;
+
+  if (!op_create (0, 0))
+    fail ("disk full");
+  phase_begin (&phase, "seq-write");
+  for (ofs = 0; ofs < size; ofs += 4096, phase.ops++)
+    if (op_write (0, ofs, 4096, buffer) != 4096)
+      fail ("disk full");
+  op_sync ();
+  phase_end (&phase);
+
+  phase_begin (&phase, "seq-read");
+  for (ofs = 0; ofs < size; ofs += 4096, phase.ops++)
+    op_read (0, ofs, 4096, buffer);
+  phase_end (&phase);
+}
+
+/* Random 512-byte reads and writes within a file a quarter the
+   size of the disk. */
+static void
+bench_rand (void)
+{
+  off_t blocks = block_size (fs_device) / 4;
+  uint8_t *buffer = get_buffer (BLOCK_SECTOR_SIZE);
+  struct phase phase;
+  int i;
+
+  srand (1);
+  if (!op_create (0, blocks * BLOCK_SECTOR_SIZE))
+    fail ("disk full");
+  phase_begin (&phase, "rand-write");
+  for (i = 0; i < 10000; i++, phase.ops++)
+    op_write (0, rand () % blocks * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE,
+              buffer);
+  op_sync ();
+  phase_end (&phase);
+
+  phase_begin (&phase, "rand-read");
+  for (i = 0; i < 10000; i++, phase.ops++)
+    op_read (0, rand () % blocks * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE,
+             buffer);
+  phase_end (&phase);
+}
+
+/* Creates, writes, reads and removes many small files. */
+static void
+bench_small (void)
+{
+  uint8_t *buffer = get_buffer (1000);
+  struct phase phase;
+  int round, id;
+
+  phase_begin (&phase, "small");
+  for (round = 0; round < 10; round++)
+    {
+      for (id = 0; id < MAX_IDS; id++, phase.ops++)
+        if (!op_create (id, 0) || op_write (id, 0, 1000, buffer) != 1000)
+          fail ("disk full");
+      for (id = 0; id < MAX_IDS; id++, phase.ops++)
+        op_read (id, 0, 1000, buffer);
+      for (id = 0; id < MAX_IDS; id++, phase.ops++)
+        op_delete (id);
+    }
+  op_sync ();
+  phase_end (&phase);
+}
+
+int
+main (int argc, char *argv[])
+{
+  block_sector_t sectors = 16384;
+  const char *image = NULL;
+  const char *bench = NULL;
+  unsigned delay = 0;
+  uint64_t reads, writes;
+  int opt, id;
+
+  while ((opt = getopt (argc, argv, "d:f:l:Tqb:")) != -1)
+    switch (opt)
+      {
+      case 'd':
+        sectors = strtoul (optarg, NULL, 10);
+        if (sectors < 16 || sectors > 65536)
+          fail ("device must have between 16 and 65536 sectors");
+        break;
+      case 'f':
+        image = optarg;
+        break;
+      case 'l':
+        delay = strtoul (optarg, NULL, 10);
+        break;
+      case 'T':
+        harness_threads = false;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'b':
+        bench = optarg;
+        break;
+      default:
+        usage ();
+      }
+  if ((bench != NULL) == (optind < argc) || argc - optind > 1)
+    usage ();
+
+  fs_device = sim_block_create (sectors, image);
+  inode_init ();
+  cache_init ();
+  free_map_init ();
+  if (image == NULL)
+    free_map_create ();
+  else
+    free_map_open ();
+  fs_device->delay = delay;
+
+  if (bench == NULL)
+    run_trace (argv[optind]);
+  else if (!strcmp (bench, "seq"))
+    bench_seq ();
+  else if (!strcmp (bench, "rand"))
+    bench_rand ();
+  else if (!strcmp (bench, "small"))
+    bench_small ();
+  else
+    usage ();
+
+  for (id = 0; id < MAX_IDS; id++)
+    if (files[id].inode != NULL)
+      inode_close (files[id].inode);
+  inode_flush_delayed ();
+  free_map_close ();
+  cache_save ();
+  sim_block_save (fs_device);
+
+  sim_block_stats (fs_device, &reads, &writes);
+  printf ("total: %"PRIu64" reads, %"PRIu64" writes, %"PRIu64" inode "
+          "changes, %ld bad reads\n", reads, writes, harness_dirty_marks,
+          mismatches);
+  return mismatches > 0;
+}
@@ -0,0 +1,24 @@
+#ifndef HARNESS_HARNESS_H
+#define HARNESS_HARNESS_H
+
+/* Interfaces between the pieces of the host harness that the
+   kernel modules do not see. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* Simulated block device. */
+struct block *sim_block_create (block_sector_t sectors, const char *image);
+void sim_block_save (struct block *);
+void sim_block_stats (struct block *, uint64_t *reads, uint64_t *writes);
+
+/* If false, thread_create() starts nothing, so that runs are
+   deterministic and the write-behind and read-ahead threads stay
+   out of profiles. */
+extern bool harness_threads;
+
+/* Number of fsck_mark_dirty() calls so far. */
+extern uint64_t harness_dirty_marks;
+
+#endif /* harness/harness.h */
@@ -0,0 +1,36 @@
+#ifndef HARNESS_BITMAP_H
+#define HARNESS_BITMAP_H
+
+/* Host stand-in for lib/kernel/bitmap.h, with the subset of its
+   interface that the file system uses.  bitmap_read() and
+   bitmap_write() store the bits in a file in the same format. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* SIZE_MAX on the kernel's 32-bit target.  free-map.c keeps results
+   in block_sector_t, so the host must use the same value. */
+#define BITMAP_ERROR ((size_t) UINT32_MAX)
+
+struct bitmap;
+struct file;
+
+struct bitmap *bitmap_create (size_t bit_cnt);
+void bitmap_destroy (struct bitmap *);
+size_t bitmap_size (const struct bitmap *);
+void bitmap_set (struct bitmap *, size_t idx, bool);
+void bitmap_mark (struct bitmap *, size_t idx);
+void bitmap_reset (struct bitmap *, size_t idx);
+bool bitmap_test (const struct bitmap *, size_t idx);
+void bitmap_set_multiple (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_count (const struct bitmap *, size_t start, size_t cnt, bool);
+bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
+size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_file_size (const struct bitmap *);
+bool bitmap_read (struct bitmap *, struct file *);
+bool bitmap_write (const struct bitmap *, struct file *);
+
+#endif /* harness bitmap.h */
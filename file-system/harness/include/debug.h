@@ -0,0 +1,35 @@
+#ifndef HARNESS_DEBUG_H
+#define HARNESS_DEBUG_H
+
+/* Host stand-in for lib/debug.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define UNUSED __attribute__ ((unused))
+#define NO_RETURN __attribute__ ((noreturn))
+#define NO_INLINE __attribute__ ((noinline))
+#define PRINTF_FORMAT(FMT, FIRST) __attribute__ ((format (printf, FMT, FIRST)))
+
+#define PANIC(...)                                                      \
+  do                                                                    \
+    {                                                                   \
+      fprintf (stderr, "PANIC at %s:%d in %s(): ", __FILE__, __LINE__,  \
+               __func__);                                               \
+      fprintf (stderr, __VA_ARGS__);                                    \
+      fprintf (stderr, "\n");                                           \
+      abort ();                                                         \
+    }                                                                   \
+  while (0)
+
+#define ASSERT(CONDITION)                                       \
+  do                                                            \
+    {                                                           \
+      if (!(CONDITION))                                         \
+        PANIC ("assertion `%s' failed.", #CONDITION);           \
+    }                                                           \
+  while (0)
+
+#define NOT_REACHED() PANIC ("executed an unreachable statement")
+
+#endif /* harness debug.h */
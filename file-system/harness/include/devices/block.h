@@ -0,0 +1,23 @@
+#ifndef DEVICES_BLOCK_H
+#define DEVICES_BLOCK_H
+
+/* Host stand-in for devices/block.h.  The only device is the
+   simulated one that harness.c sets up as fs_device. */
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOCK_SECTOR_SIZE 512
+
+typedef uint32_t block_sector_t;
+
+#define PRDSNu PRIu32
+
+struct block;
+
+void block_read (struct block *, block_sector_t, void *);
+void block_write (struct block *, block_sector_t, const void *);
+block_sector_t block_size (struct block *);
+
+#endif /* devices/block.h */
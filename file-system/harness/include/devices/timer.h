@@ -0,0 +1,14 @@
+#ifndef DEVICES_TIMER_H
+#define DEVICES_TIMER_H
+
+/* Host stand-in for devices/timer.h, ticking in real time. */
+
+#include <stdint.h>
+
+#define TIMER_FREQ 100
+
+int64_t timer_ticks (void);
+int64_t timer_elapsed (int64_t);
+void timer_sleep (int64_t ticks);
+
+#endif /* devices/timer.h */
@@ -0,0 +1,14 @@
+#ifndef FILESYS_OFF_T_H
+#define FILESYS_OFF_T_H
+
+/* Same as filesys/off_t.h.  Host headers must be kept from defining
+   their own off_t, which is why the harness is built with
+   -D__off_t_defined. */
+
+#include <stdint.h>
+
+typedef int32_t off_t;
+
+#define PROTd PRId32
+
+#endif /* filesys/off_t.h */
@@ -0,0 +1,7 @@
+#ifndef LIB_KERNEL_HASH_H
+#define LIB_KERNEL_HASH_H
+
+/* Empty host stand-in; nothing in it is used by the modules the
+   harness builds. */
+
+#endif /* lib/kernel/hash.h */
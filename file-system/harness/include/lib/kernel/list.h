@@ -0,0 +1,6 @@
+#ifndef HARNESS_LIB_KERNEL_LIST_H
+#define HARNESS_LIB_KERNEL_LIST_H
+
+#include <list.h>
+
+#endif /* lib/kernel/list.h */
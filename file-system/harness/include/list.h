@@ -0,0 +1,40 @@
+#ifndef HARNESS_LIST_H
+#define HARNESS_LIST_H
+
+/* Host stand-in for lib/kernel/list.h, with the same layout and
+   the subset of its interface that the file system uses. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct list_elem
+  {
+    struct list_elem *prev;
+    struct list_elem *next;
+  };
+
+struct list
+  {
+    struct list_elem head;
+    struct list_elem tail;
+  };
+
+#define list_entry(LIST_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(LIST_ELEM)->next     \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+void list_init (struct list *);
+struct list_elem *list_begin (struct list *);
+struct list_elem *list_next (struct list_elem *);
+struct list_elem *list_end (struct list *);
+struct list_elem *list_front (struct list *);
+void list_insert (struct list_elem *, struct list_elem *);
+void list_push_front (struct list *, struct list_elem *);
+void list_push_back (struct list *, struct list_elem *);
+struct list_elem *list_remove (struct list_elem *);
+struct list_elem *list_pop_front (struct list *);
+size_t list_size (struct list *);
+bool list_empty (struct list *);
+
+#endif /* harness list.h */
@@ -0,0 +1,10 @@
+#ifndef HARNESS_ROUND_H
+#define HARNESS_ROUND_H
+
+/* Same as lib/round.h. */
+
+#define ROUND_UP(X, STEP) (((X) + (STEP) - 1) / (STEP) * (STEP))
+#define DIV_ROUND_UP(X, STEP) (((X) + (STEP) - 1) / (STEP))
+#define ROUND_DOWN(X, STEP) ((X) / (STEP) * (STEP))
+
+#endif /* harness round.h */
@@ -0,0 +1,7 @@
+#ifndef THREADS_INIT_H
+#define THREADS_INIT_H
+
+/* Empty host stand-in; nothing in it is used by the modules the
+   harness builds. */
+
+#endif /* threads/init.h */
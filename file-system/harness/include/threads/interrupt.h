@@ -0,0 +1,7 @@
+#ifndef THREADS_INTERRUPT_H
+#define THREADS_INTERRUPT_H
+
+/* Empty host stand-in; nothing in it is used by the modules the
+   harness builds. */
+
+#endif /* threads/interrupt.h */
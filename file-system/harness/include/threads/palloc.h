@@ -0,0 +1,18 @@
+#ifndef THREADS_PALLOC_H
+#define THREADS_PALLOC_H
+
+/* Host stand-in for threads/palloc.h. */
+
+#include <stddef.h>
+
+enum palloc_flags
+  {
+    PAL_ASSERT = 001,
+    PAL_ZERO = 002,
+    PAL_USER = 004
+  };
+
+void *palloc_get_page (enum palloc_flags);
+void palloc_free_page (void *);
+
+#endif /* threads/palloc.h */
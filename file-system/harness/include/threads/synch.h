@@ -0,0 +1,34 @@
+#ifndef THREADS_SYNCH_H
+#define THREADS_SYNCH_H
+
+/* Host stand-in for threads/synch.h, on top of POSIX threads. */
+
+#include <pthread.h>
+#include <stdbool.h>
+
+struct lock
+  {
+    pthread_mutex_t mutex;
+    pthread_t holder;
+    bool held;
+  };
+
+void lock_init (struct lock *);
+void lock_acquire (struct lock *);
+bool lock_try_acquire (struct lock *);
+void lock_release (struct lock *);
+bool lock_held_by_current_thread (const struct lock *);
+
+struct condition
+  {
+    pthread_cond_t cond;
+  };
+
+void cond_init (struct condition *);
+void cond_wait (struct condition *, struct lock *);
+void cond_signal (struct condition *, struct lock *);
+void cond_broadcast (struct condition *, struct lock *);
+
+#define barrier() asm volatile ("" : : : "memory")
+
+#endif /* threads/synch.h */
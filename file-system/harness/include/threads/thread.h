@@ -0,0 +1,20 @@
+#ifndef THREADS_THREAD_H
+#define THREADS_THREAD_H
+
+/* Host stand-in for threads/thread.h.  Kernel threads are POSIX
+   threads; priorities are ignored. */
+
+#include <stdint.h>
+
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
+#define PRI_MIN 0
+#define PRI_DEFAULT 31
+#define PRI_MAX 63
+
+typedef void thread_func (void *aux);
+tid_t thread_create (const char *name, int priority, thread_func *, void *);
+void thread_yield (void);
+
+#endif /* threads/thread.h */
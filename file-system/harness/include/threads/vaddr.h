@@ -0,0 +1,9 @@
+#ifndef THREADS_VADDR_H
+#define THREADS_VADDR_H
+
+/* Host stand-in for threads/vaddr.h. */
+
+#define PGBITS 12
+#define PGSIZE (1 << PGBITS)
+
+#endif /* threads/vaddr.h */
@@ -0,0 +1,7 @@
+#ifndef USERPROG_PAGEDIR_H
+#define USERPROG_PAGEDIR_H
+
+/* Empty host stand-in; nothing in it is used by the modules the
+   harness builds. */
+
+#endif /* userprog/pagedir.h */
@@ -0,0 +1,423 @@
+/* Host implementations of the kernel facilities that cache.c,
+   inode.c, free-map.c and file.c use: lists, bitmaps, locks,
+   condition variables, threads, the timer and the page allocator,
+   each as small as the file system's use of it allows. */
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/fsck.h"
+#include "harness.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+bool harness_threads = true;
+uint64_t harness_dirty_marks;
+
+/* Lists. */
+
+void
+list_init (struct list *list)
+{
+  list->head.prev = NULL;
+  list->head.next = &list->tail;
+  list->tail.prev = &list->head;
+  list->tail.next = NULL;
+}
+
+struct list_elem *
+list_begin (struct list *list)
+{
+  return list->head.next;
+}
+
+struct list_elem *
+list_next (struct list_elem *elem)
+{
+  return elem->next;
+}
+
+struct list_elem *
+list_end (struct list *list)
+{
+  return &list->tail;
+}
+
+struct list_elem *
+list_front (struct list *list)
+{
+  ASSERT (!list_empty (list));
+  return list->head.next;
+}
+
+void
+list_insert (struct list_elem *before, struct list_elem *elem)
+{
+  elem->prev = before->prev;
+  elem->next = before;
+  before->prev->next = elem;
+  before->prev = elem;
+}
+
+void
+list_push_front (struct list *list, struct list_elem *elem)
+{
+  list_insert (list_begin (list), elem);
+}
+
+void
+list_push_back (struct list *list, struct list_elem *elem)
+{
+  list_insert (list_end (list), elem);
+}
+
+struct list_elem *
+list_remove (struct list_elem *elem)
+{
+  elem->prev->next = elem->next;
+  elem->next->prev = elem->prev;
+  return elem->next;
+}
+
+struct list_elem *
+list_pop_front (struct list *list)
+{
+  struct list_elem *front = list_front (list);
+  list_remove (front);
+  return front;
+}
+
+size_t
+list_size (struct list *list)
+{
+  size_t cnt = 0;
+  for (struct list_elem *e = list_begin (list); e != list_end (list);
+       e = list_next (e))
+    cnt++;
+  return cnt;
+}
+
+bool
+list_empty (struct list *list)
+{
+  return list_begin (list) == list_end (list);
+}
+
+/* Bitmaps, one bit per byte position as the kernel's are stored on
+   disk: bit I is bit I % 8 of byte I / 8. */
+
+struct bitmap
+  {
+    size_t bit_cnt;
+    uint8_t *bits;
+  };
+
+struct bitmap *
+bitmap_create (size_t bit_cnt)
+{
+  struct bitmap *b = malloc (sizeof *b);
+  if (b == NULL)
+    return NULL;
+  b->bit_cnt = bit_cnt;
+  b->bits = calloc (1, bitmap_file_size (b));
+  if (b->bits == NULL)
+    {
+      free (b);
+      return NULL;
+    }
+  return b;
+}
+
+void
+bitmap_destroy (struct bitmap *b)
+{
+  if (b != NULL)
+    {
+      free (b->bits);
+      free (b);
+    }
+}
+
+size_t
+bitmap_size (const struct bitmap *b)
+{
+  return b->bit_cnt;
+}
+
+void
+bitmap_set (struct bitmap *b, size_t idx, bool value)
+{
+  ASSERT (idx < b->bit_cnt);
+  if (value)
+    b->bits[idx / 8] |= 1 << (idx % 8);
+  else
+    b->bits[idx / 8] &= ~(1 << (idx % 8));
+}
+
+void
+bitmap_mark (struct bitmap *b, size_t idx)
+{
+  bitmap_set (b, idx, true);
+}
+
+void
+bitmap_reset (struct bitmap *b, size_t idx)
+{
+  bitmap_set (b, idx, false);
+}
+
+bool
+bitmap_test (const struct bitmap *b, size_t idx)
+{
+  ASSERT (idx < b->bit_cnt);
+  return (b->bits[idx / 8] >> (idx % 8)) & 1;
+}
+
+void
+bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  for (size_t i = 0; i < cnt; i++)
+    bitmap_set (b, start + i, value);
+}
+
+size_t
+bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < cnt; i++)
+    n += bitmap_test (b, start + i) == value;
+  return n;
+}
+
+bool
+bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
+{
+  return bitmap_count (b, start, cnt, true) == cnt;
+}
+
+size_t
+bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= b->bit_cnt)
+    for (size_t i = start; i <= b->bit_cnt - cnt; i++)
+      if (bitmap_count (b, i, cnt, value) == cnt)
+        return i;
+  return BITMAP_ERROR;
+}
+
+size_t
+bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx = bitmap_scan (b, start, cnt, value);
+  if (idx != BITMAP_ERROR)
+    bitmap_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
+
+/* The kernel stores 32-bit elements. */
+size_t
+bitmap_file_size (const struct bitmap *b)
+{
+  return DIV_ROUND_UP (b->bit_cnt, 32) * 4;
+}
+
+bool
+bitmap_read (struct bitmap *b, struct file *file)
+{
+  off_t size = bitmap_file_size (b);
+  return file_read_at (file, b->bits, size, 0) == size;
+}
+
+bool
+bitmap_write (const struct bitmap *b, struct file *file)
+{
+  off_t size = bitmap_file_size (b);
+  return file_write_at (file, b->bits, size, 0) == size;
+}
+
+/* Locks and condition variables. */
+
+void
+lock_init (struct lock *lock)
+{
+  pthread_mutex_init (&lock->mutex, NULL);
+  lock->held = false;
+}
+
+void
+lock_acquire (struct lock *lock)
+{
+  ASSERT (!lock_held_by_current_thread (lock));
+  pthread_mutex_lock (&lock->mutex);
+  lock->holder = pthread_self ();
+  lock->held = true;
+}
+
+bool
+lock_try_acquire (struct lock *lock)
+{
+  ASSERT (!lock_held_by_current_thread (lock));
+  if (pthread_mutex_trylock (&lock->mutex) != 0)
+    return false;
+  lock->holder = pthread_self ();
+  lock->held = true;
+  return true;
+}
+
+void
+lock_release (struct lock *lock)
+{
+  ASSERT (lock_held_by_current_thread (lock));
+  lock->held = false;
+  pthread_mutex_unlock (&lock->mutex);
+}
+
+bool
+lock_held_by_current_thread (const struct lock *lock)
+{
+  return lock->held && pthread_equal (lock->holder, pthread_self ());
+}
+
+void
+cond_init (struct condition *cond)
+{
+  pthread_cond_init (&cond->cond, NULL);
+}
+
+void
+cond_wait (struct condition *cond, struct lock *lock)
+{
+  ASSERT (lock_held_by_current_thread (lock));
+  lock->held = false;
+  pthread_cond_wait (&cond->cond, &lock->mutex);
+  lock->holder = pthread_self ();
+  lock->held = true;
+}
+
+void
+cond_signal (struct condition *cond, struct lock *lock)
+{
+  ASSERT (lock_held_by_current_thread (lock));
+  pthread_cond_signal (&cond->cond);
+}
+
+void
+cond_broadcast (struct condition *cond, struct lock *lock)
+{
+  ASSERT (lock_held_by_current_thread (lock));
+  pthread_cond_broadcast (&cond->cond);
+}
+
+/* Threads. */
+
+struct start
+  {
+    thread_func *function;
+    void *aux;
+  };
+
+static void *
+start_thread (void *start_)
+{
+  struct start start = *(struct start *) start_;
+  free (start_);
+  start.function (start.aux);
+  return NULL;
+}
+
+tid_t
+thread_create (const char *name UNUSED, int priority UNUSED,
+               thread_func *function, void *aux)
+{
+  static tid_t next_tid = 1;
+  pthread_t thread;
+  struct start *start;
+
+  if (!harness_threads)
+    return TID_ERROR;
+  start = malloc (sizeof *start);
+  if (start == NULL)
+    return TID_ERROR;
+  start->function = function;
+  start->aux = aux;
+  if (pthread_create (&thread, NULL, start_thread, start) != 0)
+    {
+      free (start);
+      return TID_ERROR;
+    }
+  pthread_detach (thread);
+  return __atomic_fetch_add (&next_tid, 1, __ATOMIC_RELAXED);
+}
+
+void
+thread_yield (void)
+{
+  sched_yield ();
+}
+
+/* Timer, ticking TIMER_FREQ times a second of real time. */
+
+static int64_t
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t
+timer_ticks (void)
+{
+  return now_ns () / (1000000000 / TIMER_FREQ);
+}
+
+int64_t
+timer_elapsed (int64_t then)
+{
+  return timer_ticks () - then;
+}
+
+void
+timer_sleep (int64_t ticks)
+{
+  int64_t ns = ticks * (1000000000 / TIMER_FREQ);
+  struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+  while (nanosleep (&ts, &ts) != 0 && errno == EINTR)
+    continue;
+}
+
+/* Page allocator. */
+
+void *
+palloc_get_page (enum palloc_flags flags)
+{
+  void *page = aligned_alloc (PGSIZE, PGSIZE);
+  if (page == NULL && (flags & PAL_ASSERT))
+    PANIC ("palloc_get: out of pages");
+  if (page != NULL && (flags & PAL_ZERO))
+    memset (page, 0, PGSIZE);
+  return page;
+}
+
+void
+palloc_free_page (void *page)
+{
+  free (page);
+}
+
+/* The harness does not link fsck.c, which needs the directory
+   layer; it only counts how often inodes would be logged. */
+void
+fsck_mark_dirty (block_sector_t sector UNUSED)
+{
+  __atomic_fetch_add (&harness_dirty_marks, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,463 @@
+/* pintos-fsck: checks, and unless told not to repairs, a Pintos file
+   system partition image on the host.
+
+   Usage: pintos-fsck [-n] IMAGE
+
+   Walks the tree from the root directory, checking every inode and
+   directory on the way, and cross-checks the free map against the
+   blocks found in use in one pass.  This is the same full check that
+   the kernel runs at boot when its log of changed inodes has
+   overflowed; see filesys/fsck.c.  Damaged files are cut short before
+   their first bad block, entries for damaged inodes are dropped, and
+   the free map is made to match.  With -n, problems are only
+   reported.  A repaired image is marked clean, so that the kernel
+   does not check it again.
+
+   Exits with status 0 if the image was clean, 1 if problems were
+   found, or 2 if it could not be checked at all.
+
+   Build with: cc -O2 -o pintos-fsck pintos-fsck.c
+
+   The on-disk formats below must match filesys/inode.c,
+   filesys/directory.c, filesys/free-map.c and filesys/fsck.c. */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_SECTOR_SIZE 512
+#define FREE_MAP_SECTOR 0
+#define ROOT_DIR_SECTOR 1
+#define FSCK_SECTOR 2
+
+/* filesys/inode.c. */
+#define INODE_MAGIC 0x494e4f44
+#define INODE_DIR 0x1
+#define INODE_COMPRESSED 0x2
+#define NUM_DIRECT 187
+#define NUM_INDIRECT 64
+#define INDIRECT_LEN 256
+#define INLINE_LEN ((NUM_DIRECT + NUM_INDIRECT) * sizeof (uint16_t))
+#define MAX_INODE_LEN (8 * 1024 * 1024)
+#define CHUNK_SECTORS 8
+
+struct inode_disk
+  {
+    int32_t length;
+    uint32_t magic;
+    uint16_t flags;
+    union
+      {
+        struct
+          {
+            uint16_t direct[NUM_DIRECT];
+            uint16_t indirect[NUM_INDIRECT];
+          };
+        uint8_t inline_data[INLINE_LEN];
+      };
+  };
+
+/* filesys/directory.c. */
+#define FS_NAME_MAX 14
+
+struct dir_entry
+  {
+    uint32_t inode_sector;
+    char name[FS_NAME_MAX + 1];
+    bool in_use;
+  };
+
+#define DIR_BUCKET_LEN (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+struct dir_header
+  {
+    uint32_t parent;
+    uint32_t bucket_cnt;
+    uint32_t entry_cnt;
+    uint32_t used_cnt;
+  };
+
+/* filesys/fsck.c. */
+#define FSCK_MAGIC 0x4b435346
+#define FSCK_LOG_LEN 124
+
+struct fsck_log
+  {
+    uint32_t magic;
+    uint32_t clean;
+    uint32_t overflow;
+    uint32_t cnt;
+    uint32_t sectors[FSCK_LOG_LEN];
+  };
+
+/* A directory whose entries are still to be checked. */
+struct pending_dir
+  {
+    uint32_t sector;
+    uint32_t parent;
+  };
+
+static uint8_t *image;          /* The partition, read into memory. */
+static uint32_t sector_cnt;     /* Sectors in IMAGE. */
+static bool *claimed;           /* Sectors found in use so far. */
+static int problems;            /* Problems found so far. */
+
+static struct pending_dir *dirs; /* Directories to visit. */
+static size_t dir_cnt, dir_cap;
+
+static void
+fail (const char *format, const char *arg)
+{
+  fprintf (stderr, "pintos-fsck: ");
+  fprintf (stderr, format, arg);
+  fprintf (stderr, "\n");
+  exit (2);
+}
+
+static void
+problem (const char *format, ...)
+{
+  va_list args;
+  va_start (args, format);
+  printf ("pintos-fsck: ");
+  vprintf (format, args);
+  printf ("\n");
+  va_end (args);
+  problems++;
+}
+
+static uint8_t *
+sector_ptr (uint32_t sector)
+{
+  return image + (size_t) sector * BLOCK_SECTOR_SIZE;
+}
+
+static struct inode_disk *
+inode_ptr (uint32_t sector)
+{
+  return (struct inode_disk *) sector_ptr (sector);
+}
+
+static bool
+is_inline (const struct inode_disk *disk)
+{
+  return (disk->flags & INODE_COMPRESSED) == 0
+         && disk->length <= (int32_t) INLINE_LEN;
+}
+
+static int
+bytes_to_sectors (int32_t size)
+{
+  return (size + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+}
+
+/* Claims SECTOR.  Returns false if it is out of range or claimed
+   already. */
+static bool
+claim (uint32_t sector)
+{
+  if (sector >= sector_cnt || claimed[sector])
+    return false;
+  claimed[sector] = true;
+  return true;
+}
+
+/* Returns the block pointer for sector IDX of block-mapped DISK. */
+static uint16_t *
+slot_ptr (struct inode_disk *disk, int idx)
+{
+  if (idx < NUM_DIRECT)
+    return &disk->direct[idx];
+  uint16_t *block = (uint16_t *)
+    sector_ptr (disk->indirect[(idx - NUM_DIRECT) / INDIRECT_LEN]);
+  return &block[(idx - NUM_DIRECT) % INDIRECT_LEN];
+}
+
+/* Checks the inode in SECTOR and claims its blocks, as inode_check()
+   in filesys/inode.c does.  Returns false if SECTOR does not hold an
+   inode. */
+static bool
+check_inode (uint32_t sector, bool *is_dir)
+{
+  struct inode_disk *disk = inode_ptr (sector);
+  if (disk->magic != INODE_MAGIC || disk->length < 0
+      || disk->length > MAX_INODE_LEN
+      || (disk->flags & ~(INODE_DIR | INODE_COMPRESSED)) != 0)
+    return false;
+  *is_dir = (disk->flags & INODE_DIR) != 0;
+  if (is_inline (disk))
+    return true;
+
+  bool compressed = (disk->flags & INODE_COMPRESSED) != 0;
+  int cnt = bytes_to_sectors (disk->length);
+  if (compressed)
+    cnt = (cnt + CHUNK_SECTORS - 1) / CHUNK_SECTORS * CHUNK_SECTORS;
+  int ind_cnt = cnt > NUM_DIRECT
+                ? (cnt - NUM_DIRECT + INDIRECT_LEN - 1) / INDIRECT_LEN : 0;
+  uint16_t *slots = calloc (cnt > 0 ? cnt : 1, sizeof *slots);
+  if (slots == NULL)
+    fail ("%s", "out of memory");
+  for (int i = 0; i < cnt && i < NUM_DIRECT; i++)
+    slots[i] = disk->direct[i];
+
+  int cut = cnt;
+  int ind_ok;
+  for (ind_ok = 0; ind_ok < ind_cnt; ind_ok++)
+    {
+      int first = NUM_DIRECT + ind_ok * INDIRECT_LEN;
+      uint16_t ind = disk->indirect[ind_ok];
+      if (ind == 0 && compressed)
+        continue;
+      if (ind == 0 || !claim (ind))
+        {
+          cut = compressed ? first / CHUNK_SECTORS * CHUNK_SECTORS : first;
+          break;
+        }
+      uint16_t *block = (uint16_t *) sector_ptr (ind);
+      for (int j = 0; j < INDIRECT_LEN && first + j < cnt; j++)
+        slots[first + j] = block[j];
+    }
+
+  for (int i = 0; i < cut; i++)
+    {
+      if (slots[i] == 0 && compressed)
+        continue;
+      if (slots[i] == 0 || !claim (slots[i]))
+        {
+          cut = compressed ? i / CHUNK_SECTORS * CHUNK_SECTORS : i;
+          for (int j = cut; j < i; j++)
+            if (slots[j] != 0)
+              claimed[slots[j]] = false;
+          break;
+        }
+    }
+  free (slots);
+  if (cut == cnt)
+    return true;
+
+  problem ("inode %u: bad block %u of %u, truncated", sector, cut, cnt);
+  disk->length = cut * BLOCK_SECTOR_SIZE;
+  for (int i = cut; i < NUM_DIRECT; i++)
+    disk->direct[i] = 0;
+  for (int ind_idx = 0; ind_idx < NUM_INDIRECT; ind_idx++)
+    {
+      int first = NUM_DIRECT + ind_idx * INDIRECT_LEN;
+      uint16_t ind = disk->indirect[ind_idx];
+      if (ind == 0 || first + INDIRECT_LEN <= cut)
+        continue;
+      if (ind_idx >= ind_ok || first >= cut)
+        {
+          if (ind_idx < ind_ok)
+            claimed[ind] = false;
+          disk->indirect[ind_idx] = 0;
+          continue;
+        }
+      uint16_t *block = (uint16_t *) sector_ptr (ind);
+      memset (block + (cut - first), 0,
+              (INDIRECT_LEN - (cut - first)) * sizeof *block);
+    }
+  return true;
+}
+
+/* Checks the inode that entry NAME of directory PARENT points to,
+   queuing it for a visit if it is a directory.  Returns false if the
+   entry should be dropped. */
+static bool
+check_entry (uint32_t sector, const char *name, uint32_t parent)
+{
+  bool is_dir;
+  if (!claim (sector))
+    {
+      problem ("%s: inode %u is out of range or linked twice", name, sector);
+      return false;
+    }
+  if (!check_inode (sector, &is_dir)
+      || (is_dir && (is_inline (inode_ptr (sector))
+                     || inode_ptr (sector)->length < 2 * BLOCK_SECTOR_SIZE)))
+    {
+      claimed[sector] = false;
+      problem ("%s: inode %u is damaged", name, sector);
+      return false;
+    }
+  if (is_dir)
+    {
+      if (dir_cnt == dir_cap)
+        {
+          dir_cap = dir_cap * 2 + 16;
+          dirs = realloc (dirs, dir_cap * sizeof *dirs);
+          if (dirs == NULL)
+            fail ("%s", "out of memory");
+        }
+      dirs[dir_cnt].sector = sector;
+      dirs[dir_cnt].parent = parent;
+      dir_cnt++;
+    }
+  return true;
+}
+
+/* Checks the directory in SECTOR, whose parent is PARENT, as
+   dir_check() in filesys/directory.c does. */
+static void
+check_dir (uint32_t sector, uint32_t parent)
+{
+  struct inode_disk *disk = inode_ptr (sector);
+  struct dir_header *hdr = (struct dir_header *)
+    sector_ptr (*slot_ptr (disk, 0));
+  uint32_t buckets = disk->length / BLOCK_SECTOR_SIZE - 1;
+  if (hdr->bucket_cnt == 0 || (hdr->bucket_cnt & (hdr->bucket_cnt - 1)) != 0
+      || hdr->bucket_cnt > buckets)
+    {
+      problem ("directory %u is damaged, emptied it", sector);
+      hdr->parent = parent;
+      hdr->bucket_cnt = 1;
+      hdr->entry_cnt = 0;
+      hdr->used_cnt = 0;
+      memset (sector_ptr (*slot_ptr (disk, 1)), 0, BLOCK_SECTOR_SIZE);
+      return;
+    }
+
+  if (hdr->parent != parent)
+    problem ("directory %u: parent is %u, should be %u", sector,
+             hdr->parent, parent);
+  hdr->parent = parent;
+  uint32_t entry_cnt = 0, used_cnt = 0;
+  for (uint32_t b = 0; b < hdr->bucket_cnt; b++)
+    {
+      struct dir_entry *bucket = (struct dir_entry *)
+        sector_ptr (*slot_ptr (disk, b + 1));
+      for (size_t j = 0; j < DIR_BUCKET_LEN; j++)
+        {
+          struct dir_entry *e = &bucket[j];
+          if (e->inode_sector == 0 && !e->in_use)
+            continue;
+          used_cnt++;
+          if (!e->in_use)
+            continue;
+          if (e->inode_sector == 0 || e->name[0] == '\0'
+              || memchr (e->name, '\0', sizeof e->name) == NULL)
+            {
+              problem ("directory %u: malformed entry %u", sector,
+                       (unsigned) (b * DIR_BUCKET_LEN + j));
+              e->in_use = false;
+              if (e->inode_sector == 0)
+                e->inode_sector = ROOT_DIR_SECTOR;
+              continue;
+            }
+          if (!check_entry (e->inode_sector, e->name, sector))
+            {
+              e->in_use = false;
+              continue;
+            }
+          entry_cnt++;
+        }
+    }
+  if (hdr->entry_cnt != entry_cnt || hdr->used_cnt != used_cnt)
+    problem ("directory %u: counts %u entries, has %u", sector,
+             hdr->entry_cnt, entry_cnt);
+  hdr->entry_cnt = entry_cnt;
+  hdr->used_cnt = used_cnt;
+}
+
+/* Makes the free map agree with CLAIMED, in one pass over both. */
+static void
+check_free_map (void)
+{
+  struct inode_disk *disk = inode_ptr (FREE_MAP_SECTOR);
+  uint32_t leaked = 0, missing = 0;
+  if (disk->length * 8 < (int64_t) sector_cnt)
+    fail ("%s", "free map is too short for the image");
+  for (uint32_t i = 0; i < sector_cnt; i++)
+    {
+      int ofs = i / 8;
+      uint8_t *byte = is_inline (disk)
+        ? &disk->inline_data[ofs]
+        : sector_ptr (*slot_ptr (disk, ofs / BLOCK_SECTOR_SIZE))
+          + ofs % BLOCK_SECTOR_SIZE;
+      bool used = (*byte >> (i % 8)) & 1;
+      if (used == claimed[i])
+        continue;
+      if (used)
+        leaked++;
+      else
+        missing++;
+      *byte ^= 1 << (i % 8);
+    }
+  if (leaked > 0 || missing > 0)
+    problem ("free map: %u sectors leaked, %u in use but free",
+             leaked, missing);
+}
+
+int
+main (int argc, char *argv[])
+{
+  bool repair = true;
+  int opt;
+  while ((opt = getopt (argc, argv, "n")) != -1)
+    if (opt == 'n')
+      repair = false;
+    else
+      fail ("%s", "usage: pintos-fsck [-n] IMAGE");
+  if (argc - optind != 1)
+    fail ("%s", "usage: pintos-fsck [-n] IMAGE");
+  const char *name = argv[optind];
+
+  FILE *f = fopen (name, "rb");
+  if (f == NULL || fseek (f, 0, SEEK_END) != 0)
+    fail ("%s: cannot open", name);
+  long size = ftell (f);
+  sector_cnt = size / BLOCK_SECTOR_SIZE;
+  if (sector_cnt <= FSCK_SECTOR || sector_cnt > UINT16_MAX + 1)
+    fail ("%s: not a file system image", name);
+  image = malloc ((size_t) sector_cnt * BLOCK_SECTOR_SIZE);
+  claimed = calloc (sector_cnt, sizeof *claimed);
+  if (image == NULL || claimed == NULL)
+    fail ("%s", "out of memory");
+  rewind (f);
+  if (fread (image, BLOCK_SECTOR_SIZE, sector_cnt, f) != sector_cnt)
+    fail ("%s: read failed", name);
+  fclose (f);
+
+  struct fsck_log *log = (struct fsck_log *) sector_ptr (FSCK_SECTOR);
+  bool had_log = log->magic == FSCK_MAGIC;
+  if (had_log && !log->clean)
+    printf ("pintos-fsck: %s was not unmounted cleanly\n", name);
+
+  bool is_dir;
+  claimed[FREE_MAP_SECTOR] = true;
+  claimed[ROOT_DIR_SECTOR] = true;
+  if (!check_inode (FREE_MAP_SECTOR, &is_dir) || is_dir)
+    fail ("%s: free map inode is damaged", name);
+  if (!check_inode (ROOT_DIR_SECTOR, &is_dir) || !is_dir
+      || inode_ptr (ROOT_DIR_SECTOR)->length < 2 * BLOCK_SECTOR_SIZE)
+    fail ("%s: root directory inode is damaged", name);
+  check_dir (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR);
+  for (size_t i = 0; i < dir_cnt; i++)
+    check_dir (dirs[i].sector, dirs[i].parent);
+
+  bool own_log = claim (FSCK_SECTOR);
+  if (!own_log)
+    printf ("pintos-fsck: sector %d is in use, no log\n", FSCK_SECTOR);
+  check_free_map ();
+
+  printf ("pintos-fsck: %s: %d problems%s\n", name, problems,
+          problems > 0 && repair ? ", fixed" : "");
+  if (repair && (problems > 0 || (own_log && (!had_log || !log->clean))))
+    {
+      if (own_log)
+        {
+          memset (log, 0, sizeof *log);
+          log->magic = FSCK_MAGIC;
+          log->clean = 1;
+        }
+      f = fopen (name, "r+b");
+      if (f == NULL
+          || fwrite (image, BLOCK_SECTOR_SIZE, sector_cnt, f) != sector_cnt
+          || fclose (f) != 0)
+        fail ("%s: write failed", name);
+    }
+  return problems > 0;
+}
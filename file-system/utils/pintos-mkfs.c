@@ -0,0 +1,426 @@
+/* pintos-mkfs: builds a formatted Pintos file system partition on
+   the host from a directory tree, so that large data sets do not
+   have to be copied in one file at a time through a running kernel.
+
+   Usage: pintos-mkfs [-s SECTORS] IMAGE DIRECTORY
+
+   Writes a partition of SECTORS sectors (default 4096, 2 MB) to
+   IMAGE holding a copy of everything under DIRECTORY, which then
+   becomes the root directory.  The result can be handed to pintos
+   with --filesys=IMAGE.
+
+   Every file gets one contiguous run: its inode, then its indirect
+   blocks, then its data.  The files of a directory are laid out
+   together in name order, followed by its subdirectories, so reading
+   a directory's files in order reads the partition sequentially.
+   Directory entries are inserted in name order as well.
+
+   Build with: cc -O2 -o pintos-mkfs pintos-mkfs.c
+
+   The on-disk formats below must match filesys/inode.c,
+   filesys/directory.c, filesys/free-map.c and filesys/fsck.c. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SECTOR_SIZE 512
+#define FREE_MAP_SECTOR 0
+#define ROOT_DIR_SECTOR 1
+#define FSCK_SECTOR 2
+
+/* filesys/inode.c. */
+#define INODE_MAGIC 0x494e4f44
+#define INODE_DIR 0x1
+#define NUM_DIRECT 187
+#define NUM_INDIRECT 64
+#define INDIRECT_LEN 256
+#define INLINE_LEN ((NUM_DIRECT + NUM_INDIRECT) * sizeof (uint16_t))
+#define MAX_INODE_LEN (8 * 1024 * 1024)
+
+struct inode_disk
+  {
+    int32_t length;
+    uint32_t magic;
+    uint16_t flags;
+    union
+      {
+        struct
+          {
+            uint16_t direct[NUM_DIRECT];
+            uint16_t indirect[NUM_INDIRECT];
+          };
+        uint8_t inline_data[INLINE_LEN];
+      };
+  };
+
+/* filesys/directory.c. */
+#define FS_NAME_MAX 14
+
+struct dir_entry
+  {
+    uint32_t inode_sector;
+    char name[FS_NAME_MAX + 1];
+    bool in_use;
+  };
+
+#define DIR_BUCKET_LEN (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+struct dir_header
+  {
+    uint32_t parent;
+    uint32_t bucket_cnt;
+    uint32_t entry_cnt;
+    uint32_t used_cnt;
+  };
+
+/* filesys/fsck.c. */
+#define FSCK_MAGIC 0x4b435346
+#define FSCK_LOG_LEN 124
+
+struct fsck_log
+  {
+    uint32_t magic;
+    uint32_t clean;
+    uint32_t overflow;
+    uint32_t cnt;
+    uint32_t sectors[FSCK_LOG_LEN];
+  };
+
+/* A file or directory to be copied in. */
+struct node
+  {
+    char name[FS_NAME_MAX + 1];
+    char *path;                 /* Path on the host. */
+    bool is_dir;
+    int32_t length;             /* Bytes of data in the image. */
+    struct node *children;      /* Directory entries, sorted by name. */
+    size_t child_cnt;
+    uint32_t sector;            /* Inode sector. */
+    uint32_t data_sector;       /* First indirect or data sector. */
+    uint32_t bucket_cnt;        /* Hash buckets, for a directory. */
+  };
+
+static uint8_t *image;          /* The partition being built. */
+static uint32_t sector_cnt;     /* Sectors in IMAGE. */
+static uint32_t next_sector;    /* Next sector to hand out. */
+
+static void
+fail (const char *format, const char *arg)
+{
+  fprintf (stderr, "pintos-mkfs: ");
+  fprintf (stderr, format, arg);
+  fprintf (stderr, "\n");
+  exit (EXIT_FAILURE);
+}
+
+static void *
+xmalloc (size_t size)
+{
+  void *p = calloc (1, size > 0 ? size : 1);
+  if (p == NULL)
+    fail ("%s", strerror (errno));
+  return p;
+}
+
+static uint8_t *
+sector_ptr (uint32_t sector)
+{
+  return image + (size_t) sector * BLOCK_SECTOR_SIZE;
+}
+
+/* Same as hash_string() in lib/kernel/hash.c. */
+static unsigned
+hash_string (const char *s_)
+{
+  const unsigned char *s = (const unsigned char *) s_;
+  unsigned hash = 2166136261u;
+  while (*s != '\0')
+    hash = (hash * 16777619u) ^ *s++;
+  return hash;
+}
+
+static size_t
+bytes_to_sectors (int32_t size)
+{
+  return (size + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the number of indirect blocks for LENGTH bytes of data. */
+static size_t
+indirect_cnt (int32_t length)
+{
+  size_t sectors = bytes_to_sectors (length);
+  if (length <= (int32_t) INLINE_LEN || sectors <= NUM_DIRECT)
+    return 0;
+  return (sectors - NUM_DIRECT + INDIRECT_LEN - 1) / INDIRECT_LEN;
+}
+
+/* Hands out CNT consecutive sectors. */
+static uint32_t
+allocate (size_t cnt)
+{
+  uint32_t first = next_sector;
+  if (cnt > sector_cnt - next_sector)
+    fail ("%s", "file system is too small for the files given");
+  next_sector += cnt;
+  return first;
+}
+
+static int
+compare_nodes (const void *a_, const void *b_)
+{
+  const struct node *a = a_;
+  const struct node *b = b_;
+  return strcmp (a->name, b->name);
+}
+
+/* Reads the host tree at NODE->path into NODE. */
+static void
+scan (struct node *node)
+{
+  struct stat st;
+  if (stat (node->path, &st) != 0)
+    fail ("%s: cannot stat", node->path);
+  node->is_dir = S_ISDIR (st.st_mode);
+  if (!node->is_dir)
+    {
+      if (st.st_size > MAX_INODE_LEN)
+        fail ("%s: file too large", node->path);
+      node->length = st.st_size;
+      return;
+    }
+
+  DIR *dir = opendir (node->path);
+  if (dir == NULL)
+    fail ("%s: cannot open directory", node->path);
+  size_t cap = 0;
+  struct dirent *de;
+  while ((de = readdir (dir)) != NULL)
+    {
+      if (!strcmp (de->d_name, ".") || !strcmp (de->d_name, ".."))
+        continue;
+      if (strlen (de->d_name) > FS_NAME_MAX)
+        fail ("%s: name too long", de->d_name);
+      if (node->child_cnt == cap)
+        {
+          cap = cap * 2 + 8;
+          node->children = realloc (node->children,
+                                    cap * sizeof *node->children);
+          if (node->children == NULL)
+            fail ("%s", strerror (errno));
+        }
+      struct node *child = &node->children[node->child_cnt];
+      memset (child, 0, sizeof *child);
+      strcpy (child->name, de->d_name);
+      child->path = xmalloc (strlen (node->path) + strlen (de->d_name) + 2);
+      sprintf (child->path, "%s/%s", node->path, de->d_name);
+      if (stat (child->path, &st) != 0
+          || (!S_ISDIR (st.st_mode) && !S_ISREG (st.st_mode)))
+        {
+          fprintf (stderr, "pintos-mkfs: %s: skipped\n", child->path);
+          free (child->path);
+          continue;
+        }
+      node->child_cnt++;
+      scan (child);
+    }
+  closedir (dir);
+  qsort (node->children, node->child_cnt, sizeof *node->children,
+         compare_nodes);
+
+  /* Size the hash table as dir_create() would for this many
+     entries. */
+  node->bucket_cnt = 1;
+  while (node->bucket_cnt * DIR_BUCKET_LEN * 3 < node->child_cnt * 4)
+    node->bucket_cnt *= 2;
+  node->length = (node->bucket_cnt + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Gives the data of NODE, whose inode sector is already chosen, a
+   run of sectors. */
+static void
+place_data (struct node *node)
+{
+  if (node->length > (int32_t) INLINE_LEN)
+    node->data_sector = allocate (indirect_cnt (node->length)
+                                  + bytes_to_sectors (node->length));
+}
+
+/* Lays out the children of directory NODE: all of its files first,
+   each inode followed by its data, then each subdirectory and what
+   it holds. */
+static void
+place_children (struct node *node)
+{
+  for (size_t i = 0; i < node->child_cnt; i++)
+    if (!node->children[i].is_dir)
+      {
+        node->children[i].sector = allocate (1);
+        place_data (&node->children[i]);
+      }
+  for (size_t i = 0; i < node->child_cnt; i++)
+    if (node->children[i].is_dir)
+      {
+        node->children[i].sector = allocate (1);
+        place_data (&node->children[i]);
+        place_children (&node->children[i]);
+      }
+}
+
+/* Writes an inode for LENGTH bytes at sector SECTOR with FLAGS,
+   whose indirect blocks and then data start at DATA_SECTOR, and
+   returns a pointer to where its data goes, which is the inode
+   itself for inline data. */
+static uint8_t *
+write_inode (uint32_t sector, int32_t length, uint16_t flags,
+             uint32_t data_sector)
+{
+  struct inode_disk *disk = (struct inode_disk *) sector_ptr (sector);
+  memset (disk, 0, sizeof *disk);
+  disk->length = length;
+  disk->magic = INODE_MAGIC;
+  disk->flags = flags;
+  if (length <= (int32_t) INLINE_LEN)
+    return disk->inline_data;
+
+  size_t ind_cnt = indirect_cnt (length);
+  uint32_t first = data_sector + ind_cnt;
+  size_t sectors = bytes_to_sectors (length);
+  for (size_t i = 0; i < sectors; i++)
+    {
+      if (i < NUM_DIRECT)
+        disk->direct[i] = first + i;
+      else
+        {
+          size_t ind_idx = (i - NUM_DIRECT) / INDIRECT_LEN;
+          size_t ind_ofs = (i - NUM_DIRECT) % INDIRECT_LEN;
+          uint16_t *block = (uint16_t *) sector_ptr (data_sector + ind_idx);
+          disk->indirect[ind_idx] = data_sector + ind_idx;
+          block[ind_ofs] = first + i;
+        }
+    }
+  return sector_ptr (first);
+}
+
+/* Writes directory NODE, whose parent directory's inode is in
+   PARENT, and everything in it. */
+static void
+write_dir (struct node *node, uint32_t parent)
+{
+  uint8_t *data = write_inode (node->sector, node->length, INODE_DIR,
+                               node->data_sector);
+  struct dir_header hdr;
+  hdr.parent = parent;
+  hdr.bucket_cnt = node->bucket_cnt;
+  hdr.entry_cnt = node->child_cnt;
+  hdr.used_cnt = node->child_cnt;
+  memcpy (data, &hdr, sizeof hdr);
+
+  /* Insert in name order, probing as place() does. */
+  for (size_t i = 0; i < node->child_cnt; i++)
+    {
+      struct node *child = &node->children[i];
+      uint32_t start = hash_string (child->name) & (hdr.bucket_cnt - 1);
+      bool placed = false;
+      for (uint32_t b = 0; !placed && b < hdr.bucket_cnt; b++)
+        {
+          uint32_t bucket = (start + b) & (hdr.bucket_cnt - 1);
+          struct dir_entry *e = (struct dir_entry *)
+            (data + (bucket + 1) * BLOCK_SECTOR_SIZE);
+          for (size_t j = 0; !placed && j < DIR_BUCKET_LEN; j++)
+            if (!e[j].in_use)
+              {
+                e[j].inode_sector = child->sector;
+                strcpy (e[j].name, child->name);
+                e[j].in_use = true;
+                placed = true;
+              }
+        }
+    }
+
+  for (size_t i = 0; i < node->child_cnt; i++)
+    {
+      struct node *child = &node->children[i];
+      if (child->is_dir)
+        write_dir (child, node->sector);
+      else
+        {
+          data = write_inode (child->sector, child->length, 0,
+                              child->data_sector);
+          FILE *f = fopen (child->path, "rb");
+          if (f == NULL
+              || fread (data, 1, child->length, f) != (size_t) child->length)
+            fail ("%s: read failed", child->path);
+          fclose (f);
+        }
+    }
+}
+
+/* Marks the first NEXT_SECTOR sectors used in a free map and stores
+   it as the free map file, whose data runs from DATA_SECTOR. */
+static void
+write_free_map (int32_t length, uint32_t data_sector)
+{
+  uint8_t *data = write_inode (FREE_MAP_SECTOR, length, 0, data_sector);
+  for (uint32_t i = 0; i < next_sector; i++)
+    data[i / 8] |= 1 << (i % 8);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int opt;
+  sector_cnt = 4096;
+  while ((opt = getopt (argc, argv, "s:")) != -1)
+    if (opt == 's')
+      sector_cnt = strtoul (optarg, NULL, 0);
+    else
+      fail ("%s", "usage: pintos-mkfs [-s SECTORS] IMAGE DIRECTORY");
+  if (argc - optind != 2)
+    fail ("%s", "usage: pintos-mkfs [-s SECTORS] IMAGE DIRECTORY");
+  if (sector_cnt < 8 || sector_cnt > UINT16_MAX + 1)
+    fail ("%s", "SECTORS must be between 8 and 65536");
+
+  struct node root;
+  memset (&root, 0, sizeof root);
+  root.path = argv[optind + 1];
+  scan (&root);
+  if (!root.is_dir)
+    fail ("%s: not a directory", root.path);
+
+  /* The free map is a bitmap of 32-bit words, as bitmap_write()
+     stores it. */
+  int32_t free_map_len = (sector_cnt + 31) / 32 * 4;
+  struct node free_map;
+  memset (&free_map, 0, sizeof free_map);
+  free_map.length = free_map_len;
+
+  next_sector = FSCK_SECTOR + 1;
+  place_data (&free_map);
+  root.sector = ROOT_DIR_SECTOR;
+  place_data (&root);
+  place_children (&root);
+
+  image = xmalloc ((size_t) sector_cnt * BLOCK_SECTOR_SIZE);
+  write_dir (&root, ROOT_DIR_SECTOR);
+  write_free_map (free_map.length, free_map.data_sector);
+  struct fsck_log *log = (struct fsck_log *) sector_ptr (FSCK_SECTOR);
+  log->magic = FSCK_MAGIC;
+  log->clean = 1;
+
+  FILE *out = fopen (argv[optind], "wb");
+  if (out == NULL
+      || fwrite (image, BLOCK_SECTOR_SIZE, sector_cnt, out) != sector_cnt
+      || fclose (out) != 0)
+    fail ("%s: write failed", argv[optind]);
+  printf ("%s: %u of %u sectors used\n", argv[optind],
+          (unsigned) next_sector, (unsigned) sector_cnt);
+  return EXIT_SUCCESS;
+}
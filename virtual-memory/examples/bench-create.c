@@ -0,0 +1,57 @@
+/* bench-create [FILES [SIZE]]
+
+   Creates FILES small files (default 200) of SIZE bytes each
+   (default 512) in a fresh directory, timing each create, open,
+   write and close as one operation, then removes them all, timing
+   each remove. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+static char buffer[4096];
+static struct bench b;
+
+int
+main (int argc, char *argv[])
+{
+  int files = bench_arg (argc, argv, 1, 200);
+  int size = bench_arg (argc, argv, 2, 512);
+  char name[16];
+
+  if (size < 0 || size > (int) sizeof buffer)
+    bench_fail ("size", argv[0]);
+  bench_fill (buffer, size, 0);
+  if (!mkdir ("storm") || !chdir ("storm"))
+    bench_fail ("mkdir", "storm");
+
+  bench_start (&b, "bench-create create");
+  for (int i = 0; i < files; i++)
+    {
+      int fd;
+      snprintf (name, sizeof name, "f%d", i);
+      bench_begin (&b);
+      if (!create (name, 0) || (fd = open (name)) < 0)
+        bench_fail ("create", name);
+      if (write (fd, buffer, size) != size)
+        bench_fail ("write", name);
+      close (fd);
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  bench_start (&b, "bench-create delete");
+  for (int i = 0; i < files; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      bench_begin (&b);
+      if (!remove (name))
+        bench_fail ("remove", name);
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  chdir ("/");
+  remove ("storm");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/* bench-lookup [DEPTH [FILES [OPS]]]
+
+   Builds a chain of DEPTH nested directories (default 4) with FILES
+   empty files (default 32) at the bottom, then times OPS (default
+   2000) opens of random files by full path, each followed by a close,
+   and as many opens of names that do not exist. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_DEPTH 16
+
+static struct bench b;
+
+/* Removes the tree built by main(), bottom up. */
+static void
+cleanup (char *path, int depth, int files)
+{
+  char name[128];
+  for (int i = 0; i < files; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", path, i);
+      remove (name);
+    }
+  for (int d = depth; d > 0; d--)
+    {
+      remove (path);
+      *strrchr (path, '/') = '\0';
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  int depth = bench_arg (argc, argv, 1, 4);
+  int files = bench_arg (argc, argv, 2, 32);
+  int ops = bench_arg (argc, argv, 3, 2000);
+  char path[128] = "";
+  char name[128];
+
+  if (depth < 1 || depth > MAX_DEPTH || files < 1)
+    bench_fail ("shape", argv[0]);
+  for (int d = 0; d < depth; d++)
+    {
+      snprintf (path + strlen (path), sizeof path - strlen (path), "/d%d", d);
+      if (!mkdir (path))
+        bench_fail ("mkdir", path);
+    }
+  for (int i = 0; i < files; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", path, i);
+      if (!create (name, 0))
+        bench_fail ("create", name);
+    }
+
+  bench_start (&b, "bench-lookup hit");
+  for (int i = 0; i < ops; i++)
+    {
+      int fd;
+      snprintf (name, sizeof name, "%s/f%lu", path, random_ulong () % files);
+      bench_begin (&b);
+      if ((fd = open (name)) < 0)
+        bench_fail ("open", name);
+      close (fd);
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  bench_start (&b, "bench-lookup miss");
+  for (int i = 0; i < ops; i++)
+    {
+      snprintf (name, sizeof name, "%s/m%lu", path, random_ulong () % files);
+      bench_begin (&b);
+      if (open (name) >= 0)
+        bench_fail ("open", name);
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  cleanup (path, depth, files);
+  return EXIT_SUCCESS;
+}
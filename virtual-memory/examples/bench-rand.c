@@ -0,0 +1,60 @@
+/* bench-rand [KB [OPS]]
+
+   Does OPS (default 2000) 512-byte reads at random sector-aligned
+   offsets in a KB-kilobyte file (default 512), and then as many
+   writes, timing each. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define IO_SIZE 512
+
+static char buffer[4096];
+static struct bench b;
+
+int
+main (int argc, char *argv[])
+{
+  int kb = bench_arg (argc, argv, 1, 512);
+  int ops = bench_arg (argc, argv, 2, 2000);
+  int sectors = kb * 1024 / IO_SIZE;
+  int fd;
+
+  if (sectors <= 0)
+    bench_fail ("size", argv[0]);
+  bench_fill (buffer, sizeof buffer, 0);
+  if (!create ("randfile", 0) || (fd = open ("randfile")) < 0)
+    bench_fail ("create", "randfile");
+  for (int i = 0; i < sectors * IO_SIZE; i += sizeof buffer)
+    write (fd, buffer, sizeof buffer);
+  if (filesize (fd) < sectors * IO_SIZE)
+    bench_fail ("fill", "randfile");
+
+  bench_start (&b, "bench-rand read");
+  for (int i = 0; i < ops; i++)
+    {
+      unsigned ofs = random_ulong () % sectors * IO_SIZE;
+      bench_begin (&b);
+      if (pread (fd, buffer, IO_SIZE, ofs) != IO_SIZE)
+        bench_fail ("read", "randfile");
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  bench_start (&b, "bench-rand write");
+  for (int i = 0; i < ops; i++)
+    {
+      unsigned ofs = random_ulong () % sectors * IO_SIZE;
+      bench_begin (&b);
+      if (pwrite (fd, buffer, IO_SIZE, ofs) != IO_SIZE)
+        bench_fail ("write", "randfile");
+      bench_end (&b);
+    }
+  bench_report (&b);
+
+  close (fd);
+  remove ("randfile");
+  return EXIT_SUCCESS;
+}
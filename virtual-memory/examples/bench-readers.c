@@ -0,0 +1,82 @@
+/* bench-readers [READERS [KB]]
+
+   Starts READERS processes (default 4) that each read the same
+   KB-kilobyte file (default 256) from start to end at the same time,
+   in 4 kB reads.  Each reader reports its own latencies; the parent
+   reports the combined throughput.
+
+   Readers are started as "bench-readers -r KB". */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define IO_SIZE 4096
+#define MAX_READERS 16
+
+static char buffer[IO_SIZE];
+static struct bench b;
+
+/* Reads the shared file once. */
+static int
+reader (int kb)
+{
+  int fd = open ("shared");
+  if (fd < 0)
+    bench_fail ("open", "shared");
+  bench_start (&b, "bench-readers reader");
+  for (int i = 0; i < kb * 1024 / IO_SIZE; i++)
+    {
+      bench_begin (&b);
+      if (read (fd, buffer, IO_SIZE) != IO_SIZE)
+        bench_fail ("read", "shared");
+      bench_end (&b);
+    }
+  bench_report (&b);
+  close (fd);
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_READERS];
+  char cmd[32];
+  int readers, kb, fd, start, elapsed;
+
+  if (argc == 3 && !strcmp (argv[1], "-r"))
+    return reader (bench_arg (argc, argv, 2, 0));
+
+  readers = bench_arg (argc, argv, 1, 4);
+  kb = bench_arg (argc, argv, 2, 256);
+  if (readers < 1 || readers > MAX_READERS)
+    bench_fail ("reader count", argv[0]);
+
+  bench_fill (buffer, IO_SIZE, 0);
+  if (!create ("shared", 0) || (fd = open ("shared")) < 0)
+    bench_fail ("create", "shared");
+  for (int i = 0; i < kb * 1024 / IO_SIZE; i++)
+    write (fd, buffer, IO_SIZE);
+  close (fd);
+
+  snprintf (cmd, sizeof cmd, "bench-readers -r %d", kb);
+  start = ticks ();
+  for (int i = 0; i < readers; i++)
+    if ((pids[i] = exec (cmd)) == PID_ERROR)
+      bench_fail ("exec", cmd);
+  for (int i = 0; i < readers; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      bench_fail ("reader", cmd);
+  elapsed = ticks () - start;
+
+  printf ("bench-readers total: %d ops in %d ticks", readers * kb * 1024
+          / IO_SIZE, elapsed);
+  if (elapsed > 0)
+    printf (", %d ops/s", readers * kb * 1024 / IO_SIZE * BENCH_TIMER_FREQ
+            / elapsed);
+  printf ("\n");
+
+  remove ("shared");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+/* bench-seq [KB [IO-SIZE]]
+
+   Writes a KB-kilobyte file (default 512) from start to end in
+   IO-SIZE-byte writes (default 4096), then reads it back the same
+   way, timing each write and read. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_IO 8192
+
+static char buffer[MAX_IO];
+static struct bench b;
+
+int
+main (int argc, char *argv[])
+{
+  int kb = bench_arg (argc, argv, 1, 512);
+  int io_size = bench_arg (argc, argv, 2, 4096);
+  int io_cnt;
+  int fd;
+
+  if (io_size <= 0 || io_size > MAX_IO)
+    bench_fail ("io size", argv[0]);
+  io_cnt = kb * 1024 / io_size;
+  bench_fill (buffer, io_size, 0);
+
+  if (!create ("seqfile", 0) || (fd = open ("seqfile")) < 0)
+    bench_fail ("create", "seqfile");
+  bench_start (&b, "bench-seq write");
+  for (int i = 0; i < io_cnt; i++)
+    {
+      bench_begin (&b);
+      if (write (fd, buffer, io_size) != io_size)
+        bench_fail ("write", "seqfile");
+      bench_end (&b);
+    }
+  bench_report (&b);
+  close (fd);
+
+  if ((fd = open ("seqfile")) < 0)
+    bench_fail ("open", "seqfile");
+  bench_start (&b, "bench-seq read");
+  for (int i = 0; i < io_cnt; i++)
+    {
+      bench_begin (&b);
+      if (read (fd, buffer, io_size) != io_size)
+        bench_fail ("read", "seqfile");
+      bench_end (&b);
+    }
+  bench_report (&b);
+  close (fd);
+
+  remove ("seqfile");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/* Timing and reporting for the file system benchmarks.
+   See bench.h. */
+
+#include "bench.h"
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Reads the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Starts a series of operations called NAME. */
+void
+bench_start (struct bench *b, const char *name)
+{
+  b->name = name;
+  b->ops = 0;
+  b->sample_cnt = 0;
+  random_init (0);
+  b->start_ticks = ticks ();
+}
+
+/* Marks the start of one operation. */
+void
+bench_begin (struct bench *b)
+{
+  b->op_start = rdtsc ();
+}
+
+/* Marks the end of the operation started by bench_begin() and
+   records its latency.  Once SAMPLES is full, keeps each new latency
+   with the probability that leaves a uniform sample of all of them. */
+void
+bench_end (struct bench *b)
+{
+  uint64_t cycles = rdtsc () - b->op_start;
+  uint32_t latency = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+
+  b->ops++;
+  if (b->sample_cnt < BENCH_MAX_SAMPLES)
+    b->samples[b->sample_cnt++] = latency;
+  else
+    {
+      unsigned long slot = random_ulong () % b->ops;
+      if (slot < BENCH_MAX_SAMPLES)
+        b->samples[slot] = latency;
+    }
+}
+
+static int
+compare_latencies (const void *a_, const void *b_)
+{
+  uint32_t a = *(const uint32_t *) a_;
+  uint32_t b = *(const uint32_t *) b_;
+  return a < b ? -1 : a > b;
+}
+
+/* Returns the latency below which PCT percent of B's samples fall.
+   The samples must be sorted. */
+static uint32_t
+percentile (const struct bench *b, int pct)
+{
+  int idx = b->sample_cnt * pct / 100;
+  if (idx >= b->sample_cnt)
+    idx = b->sample_cnt - 1;
+  return b->samples[idx];
+}
+
+/* Ends the series and prints its throughput and latencies. */
+void
+bench_report (struct bench *b)
+{
+  int elapsed = ticks () - b->start_ticks;
+
+  printf ("%s: %d ops in %d ticks, ", b->name, b->ops, elapsed);
+  if (elapsed > 0)
+    printf ("%lld ops/s", (long long) b->ops * BENCH_TIMER_FREQ / elapsed);
+  else
+    printf ("<1 tick");
+  if (b->sample_cnt > 0)
+    {
+      qsort (b->samples, b->sample_cnt, sizeof *b->samples,
+             compare_latencies);
+      printf (", cycles p50 %"PRIu32" p90 %"PRIu32" p99 %"PRIu32
+              " max %"PRIu32, percentile (b, 50), percentile (b, 90),
+              percentile (b, 99), b->samples[b->sample_cnt - 1]);
+    }
+  printf ("\n");
+}
+
+/* Reports that WHAT failed on NAME and exits. */
+void
+bench_fail (const char *what, const char *name)
+{
+  printf ("%s %s failed\n", what, name);
+  exit (EXIT_FAILURE);
+}
+
+/* Fills BUFFER with SIZE bytes that depend on SEED, so that data
+   compresses about as well as real files do. */
+void
+bench_fill (void *buffer, int size, int seed)
+{
+  uint8_t *p = buffer;
+  for (int i = 0; i < size; i++)
+    p[i] = "abcdefghijklmnopqrstuvwxyz\n"[(i * 7 + seed) % 27];
+}
+
+/* Returns ARGV[IDX] as an integer, or DFLT if there is no such
+   argument. */
+int
+bench_arg (int argc, char *argv[], int idx, int dflt)
+{
+  return idx < argc ? atoi (argv[idx]) : dflt;
+}
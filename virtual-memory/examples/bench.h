@@ -0,0 +1,46 @@
+#ifndef EXAMPLES_BENCH_H
+#define EXAMPLES_BENCH_H
+
+/* Timing and reporting for the file system benchmarks.
+
+   A benchmark times each operation with the CPU's time-stamp
+   counter and the whole run with the timer, then prints one line
+   with operations per second and latency percentiles in cycles:
+
+     bench-seq write: 128 ops in 12 ticks, 1066 ops/s,
+       cycles p50 51234 p90 60110 p99 90233 max 120400
+
+   Lines start with the benchmark name, so the output of several
+   runs can be compared with grep and diff. */
+
+#include <debug.h>
+#include <stdint.h>
+
+/* Latencies kept per benchmark.  Past this many operations, a
+   uniform sample of them is kept instead. */
+#define BENCH_MAX_SAMPLES 4096
+
+/* Must match TIMER_FREQ in devices/timer.h. */
+#define BENCH_TIMER_FREQ 100
+
+/* One timed series of operations. */
+struct bench
+  {
+    const char *name;                   /* Printed by bench_report(). */
+    int start_ticks;                    /* ticks() at bench_start(). */
+    int ops;                            /* Operations timed so far. */
+    uint64_t op_start;                  /* Counter at bench_begin(). */
+    int sample_cnt;                     /* Entries in SAMPLES. */
+    uint32_t samples[BENCH_MAX_SAMPLES]; /* Latencies, in cycles. */
+  };
+
+void bench_start (struct bench *, const char *name);
+void bench_begin (struct bench *);
+void bench_end (struct bench *);
+void bench_report (struct bench *);
+
+void bench_fail (const char *what, const char *name) NO_RETURN;
+void bench_fill (void *buffer, int size, int seed);
+int bench_arg (int argc, char *argv[], int idx, int dflt);
+
+#endif /* examples/bench.h */
@@ -0,0 +1,69 @@
+/* fsbench [BENCHMARK...]
+
+   Runs the file system benchmarks, or just the ones named, one
+   after another with their default arguments, and exits with the
+   number that failed.  Each benchmark prints its own results; see
+   bench.h for the format.
+
+   The benchmarks are separate programs so that each starts with a
+   fresh process.  To build them, add fsbench and the bench-*
+   programs to PROGS in examples/Makefile, each bench-* built from
+   its own source plus bench.c, and copy them all onto the file
+   system disk, for example:
+
+     pintos -p fsbench -a fsbench -p bench-seq -a bench-seq ... \
+       -- -q run fsbench
+
+   so that every cache.c or inode.c change can be measured against
+   the same workload. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+static const char *benchmarks[] =
+  {
+    "bench-seq",                /* Sequential write, then read. */
+    "bench-rand",               /* Random 512-byte reads and writes. */
+    "bench-create",             /* Small-file create/delete storm. */
+    "bench-readers",            /* Concurrent readers of one file. */
+    "bench-lookup",             /* Path lookups, hits and misses. */
+  };
+
+#define BENCHMARK_CNT (sizeof benchmarks / sizeof *benchmarks)
+
+/* Runs benchmark NAME and returns true if it succeeded. */
+static bool
+run (const char *name)
+{
+  pid_t pid = exec (name);
+  if (pid == PID_ERROR)
+    {
+      printf ("fsbench: cannot run %s\n", name);
+      return false;
+    }
+  if (wait (pid) != EXIT_SUCCESS)
+    {
+      printf ("fsbench: %s failed\n", name);
+      return false;
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int failed = 0;
+
+  if (argc > 1)
+    {
+      for (int i = 1; i < argc; i++)
+        failed += !run (argv[i]);
+    }
+  else
+    {
+      for (size_t i = 0; i < BENCHMARK_CNT; i++)
+        failed += !run (benchmarks[i]);
+    }
+  return failed;
+}
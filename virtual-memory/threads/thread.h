@@ -2,12 +2,15 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/synch.h"
 
+struct dir;
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -121,7 +124,13 @@ struct thread
     struct file *executing;             /* Currently executing file. */
 
     struct list files_open;
-    struct list sup_page_table;      /* Supplemental page table*/
+    struct hash sup_page_table;         /* Supplemental page table. */
+    struct hash mappings;               /* Mapped files (vm/page.c). */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, NULL for root. */
 #endif
 
     /* Owned by thread.c. */
@@ -148,6 +148,8 @@ static void page_fault(struct intr_frame *f) {
   user = (f->error_code & PF_U) != 0;
 
   // TODO: add OR condition !user (always fail if kernel page fault)
+  // A write to a present page may be the first write to a copy-on-write
+  // page after fork, which page_fetch resolves as well.
   if (!page_fetch(fault_addr, f->esp, write)) {
     printf("Page fault at %p: %s error %s page in %s context.\n", fault_addr,
              not_present ? "not present" : "rights violation",
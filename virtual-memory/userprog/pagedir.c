@@ -22,8 +22,9 @@ pagedir_create (void)
   return pd;
 }
 
-/* Destroys page directory PD, freeing all the pages it
-   references. */
+/* Destroys page directory PD.  The frames it maps belong to the
+   frame table, so they must have been given back, and unmapped,
+   with page_table_destroy() first. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
@@ -37,11 +38,6 @@ pagedir_destroy (uint32_t *pd)
     if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
-        // uint32_t *pte;
-        
-        // for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-        //   if (*pte & PTE_P) 
-        //     palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
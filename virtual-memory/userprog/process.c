@@ -34,8 +34,19 @@ struct leash{
   bool success;
   char *file_name;
   struct child *child;
+#ifdef FILESYS
+  struct dir *cwd;
+#endif
+  /* For fork: the parent and its frame on entry to the syscall. */
+  struct thread *parent;
+  const struct intr_frame *if_;
 };
 
+static tid_t spawn (const char *name, thread_func *function,
+                    struct leash *leash);
+static thread_func fork_process NO_RETURN;
+static bool fork_address_space (struct thread *parent);
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -44,44 +55,74 @@ struct leash{
 tid_t
 process_execute (const char *file_name) 
 {
-  tid_t tid;
-
   /* Create a new thread to execute FILE_NAME. */
 
   struct leash leash;
-  sema_init(&leash.success_set, 0);
   leash.file_name = palloc_get_page(0);
   if(leash.file_name == NULL){
     return TID_ERROR;
   }
   strlcpy(leash.file_name, file_name, PGSIZE);
+  return spawn (file_name, start_process, &leash);
+}
+
+/* Starts a copy of the current process, which returns from the
+   fork system call with 0 while the current one returns the new
+   process's thread id.  The copy shares the current process's
+   frames copy-on-write instead of loading its executable again.
+   Returns TID_ERROR if the thread cannot be created or the
+   address space cannot be copied.  F is the current process's
+   frame on entry to the system call. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct leash leash;
+  leash.parent = thread_current ();
+  leash.if_ = f;
+  return spawn (thread_current ()->name, fork_process, &leash);
+}
+
+/* Runs FUNCTION in a new thread named NAME to start a child
+   process, and waits until it has either started or failed.
+   Registers the child in the current process's children so that
+   it can be waited for.  Returns the child's thread id, or
+   TID_ERROR. */
+static tid_t
+spawn (const char *name, thread_func *function, struct leash *leash)
+{
+  tid_t tid;
+
+  sema_init(&leash->success_set, 0);
 
   /* Initializing struct child (other than tid). */
-  leash.child = palloc_get_page(0);
-  if (leash.child == NULL) {
+  leash->child = palloc_get_page(0);
+  if (leash->child == NULL) {
     return TID_ERROR;
   }
-  sema_init(&leash.child->terminated, 0);
-  leash.child->status = -1;
+  sema_init(&leash->child->terminated, 0);
+  leash->child->status = -1;
+#ifdef FILESYS
+  leash->cwd = thread_current()->cwd;
+#endif
 
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, &leash);
+  tid = thread_create (name, PRI_DEFAULT, function, leash);
   if (tid != TID_ERROR) {
-    sema_down(&leash.success_set);
-    if(!leash.success){
+    sema_down(&leash->success_set);
+    if(!leash->success){
       tid = TID_ERROR;
     }
   }
   if (tid == TID_ERROR) {
-    palloc_free_page (leash.child);
+    palloc_free_page (leash->child);
   } else {
     // Set struct child's tid and add to children list
-    leash.child->tid = tid;
+    leash->child->tid = tid;
 
     if (!thread_current()->children_init) {
       list_init(&thread_current()->children);
       thread_current()->children_init = true;
     }
-    list_push_back(&thread_current()->children, &leash.child->elem);
+    list_push_back(&thread_current()->children, &leash->child->elem);
 
   }
   return tid;
@@ -101,8 +142,14 @@ start_process (void *leash_)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  list_init(&thread_current()->sup_page_table);
-  leash->success = load (file_name, &if_.eip, &if_.esp);
+#ifdef FILESYS
+  /* Inherit the parent's working directory before resolving the
+     executable's name against it. */
+  if (leash->cwd != NULL)
+    thread_current()->cwd = dir_reopen(leash->cwd);
+#endif
+  leash->success = page_table_init ()
+                   && load (file_name, &if_.eip, &if_.esp);
   palloc_free_page(file_name);
   thread_current()->self = leash->child;
   thread_current()->usr_thread = true;
@@ -126,6 +173,83 @@ start_process (void *leash_)
   NOT_REACHED ();
 }
 
+/* A thread function that copies a forking process and starts the
+   copy running from the parent's system call, with 0 as the
+   return value. */
+static void
+fork_process (void *leash_)
+{
+  struct leash *leash = (struct leash*)leash_;
+  struct intr_frame if_ = *leash->if_;
+  if_.eax = 0;
+
+  thread_current()->self = leash->child;
+  thread_current()->usr_thread = true;
+  list_init(&thread_current()->files_open);
+#ifdef FILESYS
+  if (leash->cwd != NULL)
+    thread_current()->cwd = dir_reopen(leash->cwd);
+#endif
+  bool success = page_table_init ()
+                 && fork_address_space (leash->parent);
+  leash->success = success;
+
+  /* The parent may return, and LEASH go away, from here on. */
+  sema_up(&leash->success_set);
+  if (!success)
+    thread_exit ();
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current process a copy of PARENT's address space and
+   open files, which it reopens so that closing one in either
+   process leaves the other's alone.  PARENT must be blocked in
+   fork. */
+static bool
+fork_address_space (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  process_activate ();
+
+  t->executing = file_reopen (parent->executing);
+  if (t->executing == NULL)
+    return false;
+  file_deny_write (t->executing);
+
+  /* Walk backward, so that the copies end up in the same order
+     and create_fd keeps numbering from the same place. */
+  struct list *files_open = &parent->files_open;
+  for (struct list_elem *e = list_rbegin (files_open);
+       e != list_rend (files_open); e = list_prev (e))
+    {
+      struct file_store *file_s = list_entry (e, struct file_store, elem);
+      struct file_store *copy = malloc (sizeof *copy);
+      if (copy == NULL)
+        return false;
+      copy->file = file_reopen (file_s->file);
+      copy->fd = file_s->fd;
+      copy->mapped = file_s->mapped;
+#ifdef FILESYS
+      copy->dir = file_s->dir != NULL ? dir_reopen (file_s->dir) : NULL;
+#endif
+      list_push_front (&t->files_open, &copy->elem);
+      if (copy->file == NULL)
+        return false;
+      file_seek (copy->file, file_tell (file_s->file));
+      if (copy->mapped
+          && !page_fork_mapping (parent, file_s->file, copy->file))
+        return false;
+    }
+
+  return page_fork (parent);
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -204,12 +328,20 @@ process_exit (void)
           page_unmap(file_s->file);
         }
         file_close(file_s->file);
+#ifdef FILESYS
+        dir_close(file_s->dir);
+#endif
         file_elem = list_remove(file_elem);
         free(file_s);
      
     }
   }
 
+#ifdef FILESYS
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
+#endif
+
   uint32_t *pd;
 
   /* Destroy the current process's page directory and switch back
@@ -224,7 +356,7 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
-      frame_free(pd);
+      page_table_destroy ();
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -511,9 +643,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
   return true;
 }
 
-/* Loads a segment starting at offset OFS in FILE at address
-   UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
-   memory are initialized, as follows:
+/* Records a segment starting at offset OFS in FILE at address
+   UPAGE in the supplemental page table, to be loaded a page at a
+   time as the process touches it.  In total, READ_BYTES +
+   ZERO_BYTES bytes of virtual memory are initialized, as follows:
 
         - READ_BYTES bytes at UPAGE must be read from FILE
           starting at offset OFS.
@@ -524,7 +657,7 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    user process if WRITABLE is true, read-only otherwise.
 
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs or a page of the segment is already in use. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -533,7 +666,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -542,26 +674,13 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-      /* Get a page of memory. */
-      // uint8_t *kpage = palloc_get_page (PAL_USER);
-      // page_alloc(thread_current()->pagedir, upage, writable);
-      uint8_t *kpage = frame_alloc(upage, writable);
-      page_set_frame(upage, kpage, writable);
-      if (kpage == NULL)
+      if (!page_set_segment (upage, file, ofs, page_read_bytes, writable))
         return false;
 
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-    
-
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
       upage += PGSIZE;
     }
   return true;
@@ -572,15 +691,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, char **tokens, int counter) 
 {
-  uint8_t *kpage;
-
-  // TODO zero out the page
-  kpage = frame_alloc(((uint8_t *) PHYS_BASE) - PGSIZE, true);
-  if (kpage != NULL) 
+  bool success = page_add_stack (((uint8_t *) PHYS_BASE) - PGSIZE);
+  if (success) 
     {
-        // page_alloc(thread_current()->pagedir,((uint8_t *) PHYS_BASE) - PGSIZE,
-                  // true);
-        page_set_frame(((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
         *esp = PHYS_BASE;
 
         // Push strings on to the stack
@@ -621,11 +734,8 @@ setup_stack (void **esp, char **tokens, int counter)
         // Push something on to the stack during an interrupt frame, take in the bytes I want to push
         // memcopy, and increment pointer
         // setup the stack pointers then use push
-      }else{
-        palloc_free_page (kpage);
-
       }
-  return kpage != NULL;
+  return success;
 }
 
 // TODO: remove
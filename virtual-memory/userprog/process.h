@@ -8,9 +8,15 @@ struct file_store {
    int fd;
    struct list_elem elem;
    bool mapped;
+#ifdef FILESYS
+   struct dir *dir;                     /* Open directory if FILE is one. */
+#endif
 };
 
+struct intr_frame;
+
 tid_t process_execute (const char *file_name);
+tid_t process_fork (const struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
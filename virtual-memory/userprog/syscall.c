@@ -1,15 +1,20 @@
 #include "userprog/syscall.h"
 #include <inttypes.h>
+#include <iovec.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "devices/block.h"
+#include "filesys/directory.h"
 #include "filesys/inode.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "lib/kernel/stdio.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
@@ -23,7 +28,14 @@
 
 static void syscall_handler (struct intr_frame *);
 static bool is_valid_uaddr (const void *uadder, void *esp, bool write);
+static void check_string (const char *str, void *esp);
+static void check_buffer (const void *buffer, unsigned size, void *esp,
+                          bool write);
+static bool copy_iovec (struct iovec *kiov, const struct iovec *iov,
+                        int iovcnt, void *esp, bool write);
+static void put_buffer (const char *buffer, unsigned size);
 static uint32_t grab_arg(void **esp);
+static bool offset_fits (unsigned size, unsigned offset);
 static int create_fd(struct file *f, bool mapped);
 static struct file *fd_to_file(int fd);
 
@@ -40,9 +52,28 @@ static int sys_write(int fd, const void * buffer, unsigned size, void *esp);
 static void sys_seek(int fd, unsigned position);
 static unsigned sys_tell(int fd);
 static void sys_close(int fd);
+static int sys_pread(int fd, void *buffer, unsigned size, unsigned offset,
+                     void *esp);
+static int sys_pwrite(int fd, const void *buffer, unsigned size,
+                      unsigned offset, void *esp);
+static int sys_readv(int fd, const struct iovec *iov, int iovcnt, void *esp);
+static int sys_writev(int fd, const struct iovec *iov, int iovcnt,
+                      void *esp);
+static int sys_copy_range(int fd_in, int fd_out, unsigned size);
+static bool sys_compress(int fd);
+static int sys_ticks(void);
 // TODO: doesn't mmap need to check the address?
 static int sys_mmap (int fd, void *addr);
 static void sys_munmap (int mapping);
+static bool sys_fault_around (int mapping, unsigned pages);
+static pid_t sys_fork (struct intr_frame *f);
+#ifdef FILESYS
+static bool sys_chdir(const char *dir, void *esp);
+static bool sys_mkdir(const char *dir, void *esp);
+static bool sys_readdir(int fd, char *name, void *esp);
+static bool sys_isdir(int fd);
+static int sys_inumber(int fd);
+#endif
 static struct file_store *fd_to_file_store(int fd);
 static struct file *fd_to_file(int fd);
 static struct file *remove_fd(int fd);
@@ -85,11 +116,86 @@ is_valid_uaddr (const void *uaddr, void *esp, bool write) {
     return page_fetch(uaddr, esp, write);
   } else if (write && !page_is_writable(pg_round_down(uaddr))) {
     return false;
+  } else if (write && page_is_cow(pg_round_down(uaddr))) {
+    // Gives the page its own frame before the kernel writes to it
+    return page_fetch(uaddr, esp, true);
   } else {
     return true;
   }
 }
 
+/* Kills the process unless every byte of the null-terminated
+   string STR is in valid user memory. */
+static void
+check_string (const char *str, void *esp) {
+  do {
+    if (!is_valid_uaddr(str, esp, false)) {
+      sys_exit(-1);
+    }
+  } while (*str++ != '\0');
+}
+
+/* Kills the process unless the SIZE bytes at BUFFER are in valid
+   user memory, writable too if WRITE.  Looks at one address per
+   page rather than at every byte. */
+static void
+check_buffer (const void *buffer, unsigned size, void *esp, bool write) {
+  const char *start = buffer;
+  const char *end = start + size;
+  if (end < start) {
+    sys_exit(-1);
+  }
+  for (const char *p = start; p < end;
+       p = (const char *) pg_round_down(p) + PGSIZE) {
+    if (!is_valid_uaddr(p, esp, write)) {
+      sys_exit(-1);
+    }
+  }
+}
+
+/* Copies the IOVCNT-entry user array IOV into KIOV, checking the
+   array and each buffer it describes once, up front.  Kills the
+   process if any of them is invalid.  Returns false if IOVCNT is
+   out of range or the buffers add up to more than INT_MAX bytes. */
+static bool
+copy_iovec (struct iovec *kiov, const struct iovec *iov, int iovcnt,
+            void *esp, bool write) {
+  if (iovcnt < 0 || iovcnt > IOV_MAX) {
+    return false;
+  }
+  check_buffer(iov, iovcnt * sizeof *iov, esp, false);
+  memcpy(kiov, iov, iovcnt * sizeof *iov);
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    if (kiov[i].iov_len > INT_MAX - total) {
+      return false;
+    }
+    total += kiov[i].iov_len;
+    check_buffer(kiov[i].iov_base, kiov[i].iov_len, esp, write);
+  }
+  return true;
+}
+
+/* Returns true if SIZE bytes at OFFSET, both from user space,
+   lie within the range of off_t, so that neither turns negative
+   on the way to the file system. */
+static bool
+offset_fits (unsigned size, unsigned offset) {
+  return offset <= INT_MAX && size <= INT_MAX - offset;
+}
+
+/* Writes SIZE bytes from BUFFER to the console, in pieces of at
+   most MAX_PUTBUF_LEN bytes so that other output can interleave. */
+static void
+put_buffer (const char *buffer, unsigned size) {
+  while (size > MAX_PUTBUF_LEN) {
+    putbuf(buffer, MAX_PUTBUF_LEN);
+    buffer += MAX_PUTBUF_LEN;
+    size -= MAX_PUTBUF_LEN;
+  }
+  putbuf(buffer, (size_t)size);
+}
+
 static void
 syscall_handler (struct intr_frame *f) 
 {
@@ -161,6 +267,45 @@ syscall_handler (struct intr_frame *f)
       int fd = (int)grab_arg(&esp);
       sys_close(fd);
       break;
+    } case SYS_PREAD:{
+      int fd = (int)grab_arg(&esp);
+      void *buffer = (void*)grab_arg(&esp);
+      unsigned size = (unsigned)grab_arg(&esp);
+      unsigned offset = (unsigned)grab_arg(&esp);
+      f->eax = (uint32_t) sys_pread(fd, buffer, size, offset, esp_original);
+      break;
+    } case SYS_PWRITE:{
+      int fd = (int)grab_arg(&esp);
+      void *buffer = (void*)grab_arg(&esp);
+      unsigned size = (unsigned)grab_arg(&esp);
+      unsigned offset = (unsigned)grab_arg(&esp);
+      f->eax = (uint32_t) sys_pwrite(fd, buffer, size, offset, esp_original);
+      break;
+    } case SYS_READV:{
+      int fd = (int)grab_arg(&esp);
+      struct iovec *iov = (struct iovec *)grab_arg(&esp);
+      int iovcnt = (int)grab_arg(&esp);
+      f->eax = (uint32_t) sys_readv(fd, iov, iovcnt, esp_original);
+      break;
+    } case SYS_WRITEV:{
+      int fd = (int)grab_arg(&esp);
+      struct iovec *iov = (struct iovec *)grab_arg(&esp);
+      int iovcnt = (int)grab_arg(&esp);
+      f->eax = (uint32_t) sys_writev(fd, iov, iovcnt, esp_original);
+      break;
+    } case SYS_COPY_RANGE:{
+      int fd_in = (int)grab_arg(&esp);
+      int fd_out = (int)grab_arg(&esp);
+      unsigned size = (unsigned)grab_arg(&esp);
+      f->eax = (uint32_t) sys_copy_range(fd_in, fd_out, size);
+      break;
+    } case SYS_COMPRESS:{
+      int fd = (int)grab_arg(&esp);
+      f->eax = (uint32_t) sys_compress(fd);
+      break;
+    } case SYS_TICKS:{
+      f->eax = (uint32_t) sys_ticks();
+      break;
     } case SYS_MMAP:{
       int fd = (int)grab_arg(&esp);
       void *addr = (void *)grab_arg(&esp);
@@ -170,6 +315,37 @@ syscall_handler (struct intr_frame *f)
       int mapping = (int)grab_arg(&esp);
       sys_munmap(mapping);
       break;
+    } case SYS_FAULT_AROUND:{
+      int mapping = (int)grab_arg(&esp);
+      unsigned pages = (unsigned)grab_arg(&esp);
+      f->eax = (uint32_t)sys_fault_around(mapping, pages);
+      break;
+    } case SYS_FORK:{
+      f->eax = (uint32_t)sys_fork(f);
+      break;
+#ifdef FILESYS
+    } case SYS_CHDIR:{
+      char *dir = (char *)grab_arg(&esp);
+      f->eax = (uint32_t)sys_chdir(dir, esp_original);
+      break;
+    } case SYS_MKDIR:{
+      char *dir = (char *)grab_arg(&esp);
+      f->eax = (uint32_t)sys_mkdir(dir, esp_original);
+      break;
+    } case SYS_READDIR:{
+      int fd = (int)grab_arg(&esp);
+      char *name = (char *)grab_arg(&esp);
+      f->eax = (uint32_t)sys_readdir(fd, name, esp_original);
+      break;
+    } case SYS_ISDIR:{
+      int fd = (int)grab_arg(&esp);
+      f->eax = (uint32_t)sys_isdir(fd);
+      break;
+    } case SYS_INUMBER:{
+      int fd = (int)grab_arg(&esp);
+      f->eax = (uint32_t)sys_inumber(fd);
+      break;
+#endif
     } default:{
       printf ("system call! %d\n", number);
       thread_exit ();
@@ -191,6 +367,9 @@ static int create_fd(struct file *f, bool mapped){
     : list_entry(list_front(files_open), struct file_store, elem)->fd + 1;
   file_s->file = f;
   file_s->mapped = mapped;
+#ifdef FILESYS
+  file_s->dir = NULL;
+#endif
 
   list_push_front(files_open, &file_s->elem);
 
@@ -210,6 +389,7 @@ static struct file_store *fd_to_file_store(int fd){
     if(file_s->fd == fd){
       break;
     }
+    file_s = NULL;
   }
 
   return file_s;
@@ -281,7 +461,18 @@ static int sys_open(const char *file, void *esp){
     sys_exit(-1);
   }
   struct file *f = filesys_open(file);
-  return create_fd(f, false);
+  int fd = create_fd(f, false);
+#ifdef FILESYS
+  if (fd != -1 && inode_is_dir(file_get_inode(f))) {
+    struct dir *dir = dir_open(inode_reopen(file_get_inode(f)));
+    if (dir == NULL) {
+      sys_close(fd);
+      return -1;
+    }
+    fd_to_file_store(fd)->dir = dir;
+  }
+#endif
+  return fd;
 }
 
 static int sys_filesize(int fd){
@@ -300,14 +491,13 @@ static int sys_read(int fd, void *buffer, unsigned size, void* esp){
     return (int)input_getc();
   }
 
-  for (unsigned i = 0; i < size; i++) {
-    if (!is_valid_uaddr((char *)buffer + i, esp, true)) {
-      sys_exit(-1);
-    }
-  }
+  check_buffer(buffer, size, esp, true);
 
   struct file *f = fd_to_file(fd);
   if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
   return (int)file_read(f, buffer, (off_t)size);
 }
 
@@ -315,22 +505,16 @@ static int sys_write(int fd, const void * buffer, unsigned size, void *esp){
   if(fd == STD_IN || !is_valid_uaddr(buffer, esp, false)){
     sys_exit(-1);
   }
-  for (unsigned i = 0; i < size; i++) {
-    if (!is_valid_uaddr((const char *)buffer + i, esp, false)) {
-      sys_exit(-1);
-    }
-  }
+  check_buffer(buffer, size, esp, false);
   if(fd == STD_OUT){
-    unsigned remaining = size;
-    while (remaining > MAX_PUTBUF_LEN) {
-      putbuf(buffer, MAX_PUTBUF_LEN);
-      remaining -= MAX_PUTBUF_LEN;
-    }
-    putbuf(buffer, (size_t)remaining);
+    put_buffer(buffer, size);
     return (int)size;
   }
   struct file *f = fd_to_file(fd);
   if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
   // TODO: split writes into page chunks in case we can't load all at once
   // maybe the best thing would be to have page_fetch indicate what action needs
   // to be taken instead of taking it itself. This would resolve the detection
@@ -353,10 +537,116 @@ static unsigned sys_tell(int fd){
 }
 
 static void sys_close(int fd){
-  struct file *f = remove_fd(fd);
-  if(f == NULL){
+  struct file_store *file_s = fd_to_file_store(fd);
+  if(file_s == NULL){
+    sys_exit(-1);
+  }
+  if(file_s->mapped){
+    // Mappings are only torn down by munmap or exit.
+    return;
+  }
+  list_remove(&file_s->elem);
+  file_close(file_s->file);
+#ifdef FILESYS
+  dir_close(file_s->dir);
+#endif
+  free(file_s);
+}
+
+static int sys_pread(int fd, void *buffer, unsigned size, unsigned offset,
+                     void *esp){
+  if(fd == STD_IN || fd == STD_OUT){return -1;}
+  if(!offset_fits(size, offset)){return -1;}
+  check_buffer(buffer, size, esp, true);
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
+  return (int)file_read_at(f, buffer, (off_t)size, (off_t)offset);
+}
+
+static int sys_pwrite(int fd, const void *buffer, unsigned size,
+                      unsigned offset, void *esp){
+  if(fd == STD_IN || fd == STD_OUT){return -1;}
+  if(!offset_fits(size, offset)){return -1;}
+  check_buffer(buffer, size, esp, false);
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
+  return (int)file_write_at(f, buffer, (off_t)size, (off_t)offset);
+}
+
+static int sys_readv(int fd, const struct iovec *iov, int iovcnt, void *esp){
+  struct iovec kiov[IOV_MAX];
+  if(fd == STD_OUT){
     sys_exit(-1);
   }
+  if(!copy_iovec(kiov, iov, iovcnt, esp, true)){return -1;}
+  if(fd == STD_IN){
+    int bytes_read = 0;
+    for (int i = 0; i < iovcnt; i++) {
+      uint8_t *buffer = kiov[i].iov_base;
+      for (size_t j = 0; j < kiov[i].iov_len; j++) {
+        buffer[j] = input_getc();
+      }
+      bytes_read += kiov[i].iov_len;
+    }
+    return bytes_read;
+  }
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
+  return (int)file_readv(f, kiov, iovcnt);
+}
+
+static int sys_writev(int fd, const struct iovec *iov, int iovcnt,
+                      void *esp){
+  struct iovec kiov[IOV_MAX];
+  if(fd == STD_IN){
+    sys_exit(-1);
+  }
+  if(!copy_iovec(kiov, iov, iovcnt, esp, false)){return -1;}
+  if(fd == STD_OUT){
+    int bytes_written = 0;
+    for (int i = 0; i < iovcnt; i++) {
+      put_buffer(kiov[i].iov_base, kiov[i].iov_len);
+      bytes_written += kiov[i].iov_len;
+    }
+    return bytes_written;
+  }
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(f))){return -1;}
+#endif
+  return (int)file_writev(f, kiov, iovcnt);
+}
+
+static int sys_copy_range(int fd_in, int fd_out, unsigned size){
+  struct file *in = fd_to_file(fd_in);
+  struct file *out = fd_to_file(fd_out);
+  if(in == NULL || out == NULL || size > INT_MAX){return -1;}
+#ifdef FILESYS
+  if(inode_is_dir(file_get_inode(in)) || inode_is_dir(file_get_inode(out))){
+    return -1;
+  }
+#endif
+  return (int)file_copy(out, in, (off_t)size);
+}
+
+static bool sys_compress(int fd){
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){return false;}
+  return inode_set_compressed(file_get_inode(f));
+}
+
+static int sys_ticks(void){
+  return (int)timer_ticks();
 }
 
 static int sys_mmap (int fd, void *addr){
@@ -402,4 +692,51 @@ static void sys_munmap (int mapping){
   page_unmap(f);
   remove_fd(mapping);
   file_close(f);
-}
\ No newline at end of file
+}
+
+static bool sys_fault_around (int mapping, unsigned pages){
+  struct file_store *file_s = fd_to_file_store(mapping);
+  if(file_s == NULL || !file_s->mapped){
+    return false;
+  }
+  return page_set_fault_around(file_s->file, pages);
+}
+
+static pid_t sys_fork (struct intr_frame *f){
+  return (pid_t)process_fork(f);
+}
+
+#ifdef FILESYS
+static bool sys_chdir(const char *dir, void *esp){
+  check_string(dir, esp);
+  return filesys_chdir(dir);
+}
+
+static bool sys_mkdir(const char *dir, void *esp){
+  check_string(dir, esp);
+  return filesys_mkdir(dir);
+}
+
+static bool sys_readdir(int fd, char *name, void *esp){
+  check_buffer(name, NAME_MAX + 1, esp, true);
+  struct file_store *file_s = fd_to_file_store(fd);
+  if(file_s == NULL || file_s->dir == NULL){return false;}
+  return dir_readdir(file_s->dir, name);
+}
+
+static bool sys_isdir(int fd){
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){
+    sys_exit(-1);
+  }
+  return inode_is_dir(file_get_inode(f));
+}
+
+static int sys_inumber(int fd){
+  struct file *f = fd_to_file(fd);
+  if(f == NULL){
+    sys_exit(-1);
+  }
+  return (int)inode_get_inumber(file_get_inode(f));
+}
+#endif
\ No newline at end of file
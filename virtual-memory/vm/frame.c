@@ -20,122 +20,416 @@
 #include "vm/swap.h"
 
 
-// User frame struct
-struct frame {
-    struct list_elem elem;
-    void *kpage; // frame
-    //-------------
-    uint32_t *pd; // looking at thread_current()
-    void *upage; // user page (starting address of the page)
-};
-
-// global list
+// Free frames below which the page-out thread starts evicting
+#define PAGEOUT_LOW 16
+// Free frames the page-out thread evicts up to
+#define PAGEOUT_HIGH 32
+// Pages the page-out thread writes out per trip
+#define PAGEOUT_BATCH 8
+#define PAGEOUT_PRIORITY PRI_DEFAULT
+
+// Frames holding pages, in clock order
 static struct list frame_table;
+static size_t used_cnt;
+// Frames holding nothing
+static struct list free_frames;
+static size_t free_cnt;
+// Protects the lists and counts, the clock hand, every frame's pages and
+// the pinned and evicting flags of pages
 static struct lock frame_table_lock;
-// global list elem
-static struct list_elem *next_frame;
-
-static struct frame *get_next_frame(void);
-static void evict_frame(struct frame *f);
+// Signaled when a page stops being evicted
+static struct condition eviction_done;
+// Signaled when free frames run low
+static struct condition pageout_wanted;
+// Next frame in frame_table for the clock to look at
+static struct list_elem *hand;
+// Frames holding read-only executable pages, by inode and offset, so
+// that processes running the same program share its code
+static struct hash text_frames;
 
 static struct frame *frame_clock(void);
+static void clock_advance(void);
+static void attach(struct frame *f);
+static void detach(struct frame *f);
+static bool frame_pinned(struct frame *f);
+static bool frame_accessed(struct frame *f);
+static struct frame *evict(void);
+static void evict_pages(struct frame *f);
+static struct frame *take_frame(void);
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+static void forget_text(struct frame *f);
+static void free_frame(struct frame *f);
+static thread_func pageout;
 
-static struct frame *frame_clock(void){
-    lock_acquire(&frame_table_lock);
-    struct frame *frame_s = NULL;
-    for(struct list_elem *frame_elem = list_begin(&frame_table);
-                            frame_elem != list_end(&frame_table);
-                            frame_elem = list_next(frame_elem)
-                            ) {
-        
-        if(frame_elem == NULL){break;}
-        frame_s = list_entry(frame_elem, struct frame, elem);
-        if(pagedir_is_accessed(frame_s->pd, frame_s->upage)){
-            pagedir_set_accessed(frame_s->pd, frame_s->upage, false);
-        }else{
-            break;
+static void clock_advance(void) {
+    hand = list_next(hand);
+    if (hand == list_end(&frame_table)) {
+        hand = list_begin(&frame_table);
+    }
+}
+
+// Puts F in the frame table just behind the hand, so that it is the
+// last frame the clock looks at.
+static void attach(struct frame *f) {
+    list_insert(hand, &f->elem);
+    if (hand == list_end(&frame_table)) {
+        hand = list_begin(&frame_table);
+    }
+    used_cnt++;
+}
+
+static void detach(struct frame *f) {
+    if (hand == &f->elem) {
+        clock_advance();
+    }
+    list_remove(&f->elem);
+    if (list_empty(&frame_table)) {
+        hand = list_end(&frame_table);
+    }
+    used_cnt--;
+}
+
+static unsigned text_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct frame *f = hash_entry(e, struct frame, text_elem);
+    return hash_bytes(&f->inode, sizeof f->inode) ^ hash_int(f->off);
+}
+
+static bool text_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                      void *aux UNUSED) {
+    const struct frame *a = hash_entry(a_, struct frame, text_elem);
+    const struct frame *b = hash_entry(b_, struct frame, text_elem);
+    if (a->inode != b->inode) {
+        return a->inode < b->inode;
+    }
+    if (a->off != b->off) {
+        return a->off < b->off;
+    }
+    return a->read_bytes < b->read_bytes;
+}
+
+// Takes F out of text_frames, once it stops holding its page.
+static void forget_text(struct frame *f) {
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+    if (f->inode != NULL) {
+        hash_delete(&text_frames, &f->text_elem);
+        f->inode = NULL;
+    }
+}
+
+// Returns F, which no page holds any more, to the free pool.
+static void free_frame(struct frame *f) {
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+    ASSERT(list_empty(&f->pages));
+    detach(f);
+    forget_text(f);
+    list_push_back(&free_frames, &f->elem);
+    free_cnt++;
+}
+
+static bool frame_pinned(struct frame *f) {
+    for (struct list_elem *e = list_begin(&f->pages);
+         e != list_end(&f->pages); e = list_next(e)) {
+        if (list_entry(e, struct page, frame_elem)->pinned) {
+            return true;
         }
-          
     }
-    lock_release(&frame_table_lock);
-    return frame_s;
+    return false;
 }
 
+// Returns true if any page in F was accessed since the last call, and
+// clears the accessed bits of all of them.
+static bool frame_accessed(struct frame *f) {
+    bool accessed = false;
+    for (struct list_elem *e = list_begin(&f->pages);
+         e != list_end(&f->pages); e = list_next(e)) {
+        struct page *page_s = list_entry(e, struct page, frame_elem);
+        if (pagedir_is_accessed(page_s->pd, page_s->upage)) {
+            pagedir_set_accessed(page_s->pd, page_s->upage, false);
+            accessed = true;
+        }
+    }
+    return accessed;
+}
 
-static void evict_frame(struct frame *f){
-    // receiving a frame to evict;
-    struct swap_slot *ss = swap_out(f->kpage);
-    ASSERT(page_set_swap(f->upage, ss));
+// Second-chance clock: returns the first frame after the hand whose
+// pages have not been accessed since the hand last passed it, clearing
+// accessed bits on the way, or null if every frame is pinned. Two
+// sweeps are enough to find one otherwise.
+static struct frame *frame_clock(void){
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+    for (size_t i = 0; i < 2 * used_cnt; i++) {
+        struct frame *frame_s = list_entry(hand, struct frame, elem);
+        clock_advance();
+        if (!frame_pinned(frame_s) && !frame_accessed(frame_s)) {
+            return frame_s;
+        }
+    }
+    return NULL;
+}
 
+// Takes a victim from the clock out of the frame table and marks its
+// pages as being evicted, or returns null if there is none. The caller
+// then writes the pages out with evict_pages, without the lock, and
+// finishes with evict_done.
+static struct frame *evict(void) {
+    struct frame *f = frame_clock();
+    if (f != NULL) {
+        detach(f);
+        forget_text(f);
+        for (struct list_elem *e = list_begin(&f->pages);
+             e != list_end(&f->pages); e = list_next(e)) {
+            list_entry(e, struct page, frame_elem)->evicting = true;
+        }
+    }
+    return f;
 }
 
-static struct frame *get_next_frame(void) {
-    static bool fail_on_next = false;
-    struct frame *f;
-    if (fail_on_next) {
-        // Must use clock from this point on thus we must evict frames
-        f = frame_clock();
-        ASSERT(f != NULL);
-        evict_frame(f);
-        return f;
+// The pages of F cannot leave it while they are being evicted, so the
+// list may be walked without the lock.
+static void evict_pages(struct frame *f) {
+    if (list_size(&f->pages) == 1) {
+        page_evict(list_entry(list_front(&f->pages), struct page, frame_elem));
+    } else {
+        page_evict_shared(f);
     }
+}
+
+static void evict_done(struct frame *f) {
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+    while (!list_empty(&f->pages)) {
+        struct page *page_s =
+            list_entry(list_pop_front(&f->pages), struct page, frame_elem);
+        page_s->evicting = false;
+    }
+    cond_broadcast(&eviction_done, &frame_table_lock);
+}
+
+// Page-out thread: whenever free frames drop below PAGEOUT_LOW, evicts
+// pages in batches until PAGEOUT_HIGH are free, so that page faults
+// find a free frame instead of writing a victim out themselves.
+static void pageout(void *aux UNUSED) {
     lock_acquire(&frame_table_lock);
-    f = list_entry(next_frame, struct frame, elem);
-    next_frame = list_next(next_frame);
-    if (next_frame == list_end(&frame_table)) {
-        next_frame = list_begin(&frame_table);
-        fail_on_next = true;
+    for (;;) {
+        while (free_cnt >= PAGEOUT_LOW) {
+            cond_wait(&pageout_wanted, &frame_table_lock);
+        }
+
+        struct frame *batch[PAGEOUT_BATCH];
+        size_t cnt = 0;
+        while (cnt < PAGEOUT_BATCH && free_cnt + cnt < PAGEOUT_HIGH
+               && (batch[cnt] = evict()) != NULL) {
+            cnt++;
+        }
+        if (cnt == 0) {
+            // Everything is pinned; try again when something changes
+            cond_wait(&pageout_wanted, &frame_table_lock);
+            continue;
+        }
+
+        lock_release(&frame_table_lock);
+        for (size_t i = 0; i < cnt; i++) {
+            evict_pages(batch[i]);
+        }
+        lock_acquire(&frame_table_lock);
+        for (size_t i = 0; i < cnt; i++) {
+            evict_done(batch[i]);
+            list_push_back(&free_frames, &batch[i]->elem);
+            free_cnt++;
+        }
     }
-    lock_release(&frame_table_lock);
-    return f;
 }
 
 void frame_init(void){
     list_init(&frame_table);
+    list_init(&free_frames);
     lock_init(&frame_table_lock);
+    cond_init(&eviction_done);
+    cond_init(&pageout_wanted);
+    used_cnt = free_cnt = 0;
+    if (!hash_init(&text_frames, text_hash, text_less, NULL)) {
+        PANIC("frame_init: out of memory");
+    }
     void *kpage = palloc_get_page(PAL_USER);
     while(kpage != NULL){
         struct frame *cur_frame = malloc(sizeof(struct frame));
         cur_frame->kpage = kpage;
-        cur_frame->upage = NULL;
-        cur_frame->pd = NULL;
-        list_push_back(&frame_table, &cur_frame->elem);
-        kpage = palloc_get_page(PAL_USER);        
+        list_init(&cur_frame->pages);
+        cur_frame->inode = NULL;
+        list_push_back(&free_frames, &cur_frame->elem);
+        free_cnt++;
+        kpage = palloc_get_page(PAL_USER);
+    }
+    ASSERT(!list_empty(&free_frames));
+    hand = list_end(&frame_table);
+    thread_create("pageout", PAGEOUT_PRIORITY, pageout, NULL);
+}
+
+// Returns a frame holding nothing, with the lock held. Normally a free
+// frame is at hand; if the page-out thread has fallen behind, a victim
+// is evicted here, which drops the lock meanwhile.
+static struct frame *take_frame(void) {
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+    struct frame *f;
+    if (!list_empty(&free_frames)) {
+        f = list_entry(list_pop_front(&free_frames), struct frame, elem);
+        free_cnt--;
+    } else {
+        f = evict();
+        if (f == NULL) {
+            PANIC("no frame to evict");
+        }
+        lock_release(&frame_table_lock);
+        evict_pages(f);
+        lock_acquire(&frame_table_lock);
+        evict_done(f);
+    }
+    if (free_cnt < PAGEOUT_LOW) {
+        cond_signal(&pageout_wanted, &frame_table_lock);
+    }
+    return f;
+}
+
+// Returns a frame for PAGE, which must be pinned. The frame is not
+// mapped; the caller fills it and installs it in PAGE's page directory.
+struct frame *frame_alloc(struct page *page){
+    ASSERT(page->pinned);
+    lock_acquire(&frame_table_lock);
+    struct frame *f = take_frame();
+    list_push_back(&f->pages, &page->frame_elem);
+    attach(f);
+    lock_release(&frame_table_lock);
+    return f;
+}
+
+// Returns a free frame for PAGE, which must be pinned, or null if that
+// would leave fewer than PAGEOUT_LOW free. For optional work, such as
+// bringing in pages before they are needed, that should never cause an
+// eviction.
+struct frame *frame_try_alloc(struct page *page){
+    ASSERT(page->pinned);
+    lock_acquire(&frame_table_lock);
+    struct frame *f = NULL;
+    if (free_cnt > PAGEOUT_LOW) {
+        f = list_entry(list_pop_front(&free_frames), struct frame, elem);
+        free_cnt--;
+        list_push_back(&f->pages, &page->frame_elem);
+        attach(f);
+    }
+    lock_release(&frame_table_lock);
+    return f;
+}
+
+// Pins PAGE, waiting for any eviction of it in progress to finish, so
+// that it stays in memory or out of it until unpinned.
+void frame_pin(struct page *page){
+    lock_acquire(&frame_table_lock);
+    while (page->evicting) {
+        cond_wait(&eviction_done, &frame_table_lock);
+    }
+    page->pinned = true;
+    lock_release(&frame_table_lock);
+}
+
+// Pins PAGE, like frame_pin, unless it is being evicted or is pinned
+// already, in which case it returns false at once. For optional work on
+// pages other than the faulting one.
+bool frame_try_pin(struct page *page){
+    lock_acquire(&frame_table_lock);
+    bool success = !page->evicting && !page->pinned;
+    if (success) {
+        page->pinned = true;
     }
-    ASSERT(!list_empty(&frame_table));
-    next_frame = list_front(&frame_table);
+    lock_release(&frame_table_lock);
+    return success;
 }
 
-void *frame_alloc(void *upage, bool writable){
-    uint32_t *pd = thread_current()->pagedir;
-    struct frame *f = get_next_frame();
+// Adds PAGE to the pages sharing F. Some page already in F must be
+// pinned, so that F is not evicted meanwhile. Every page in F must be
+// mapped read-only, so that they keep seeing the same contents.
+void frame_share(struct frame *f, struct page *page){
+    lock_acquire(&frame_table_lock);
+    ASSERT(frame_pinned(f));
+    list_push_back(&f->pages, &page->frame_elem);
+    lock_release(&frame_table_lock);
+}
 
-    if(pagedir_get_page (pd, upage) != NULL || !pagedir_set_page(pd, upage, f->kpage, writable)){
-        printf("Memory allocation failed!\n");
-        NOT_REACHED()
+// Gives the pinned PAGE a frame of its own, with a copy of the contents
+// of the frame it shares, and returns it. Returns PAGE's frame as it is
+// if no other page shares it any more. The caller maps the frame
+// returned in place of the old one.
+struct frame *frame_unshare(struct page *page){
+    ASSERT(page->pinned);
+    struct frame *old = page->frame;
+    lock_acquire(&frame_table_lock);
+    if (list_size(&old->pages) == 1) {
+        lock_release(&frame_table_lock);
+        return old;
+    }
+    struct frame *f = take_frame();
+    // PAGE is still in OLD and pinned, so OLD stays put while copying
+    lock_release(&frame_table_lock);
+    memcpy(f->kpage, old->kpage, PGSIZE);
+    lock_acquire(&frame_table_lock);
+    list_remove(&page->frame_elem);
+    // The other pages may have left OLD while it was copied
+    if (list_empty(&old->pages)) {
+        free_frame(old);
     }
-    
-    f->upage = upage;
-    f->pd = pd;
-    return f->kpage;
+    list_push_back(&f->pages, &page->frame_elem);
+    attach(f);
+    lock_release(&frame_table_lock);
+    return f;
 }
 
-void frame_free(uint32_t * pd){
-    for(struct list_elem *frame_elem = list_begin(&frame_table);
-                            frame_elem != list_end(&frame_table);
-                            frame_elem = list_next(frame_elem)
-                            ) {
-        
-        if(frame_elem == NULL){break;}
-        
-        struct frame *frame_s = list_entry(frame_elem, struct frame, elem);
-        if(frame_s->pd == pd){
-            frame_s->pd = NULL;
-            frame_s->upage = NULL;
-        }         
+// Takes PAGE out of frame F, and returns F to the free pool if no other
+// page shares it. PAGE must be pinned, so that F cannot be evicted
+// meanwhile, and unmapped.
+void frame_release(struct frame *f, struct page *page){
+    lock_acquire(&frame_table_lock);
+    ASSERT(page->pinned);
+    list_remove(&page->frame_elem);
+    if (list_empty(&f->pages)) {
+        free_frame(f);
     }
+    lock_release(&frame_table_lock);
 }
 
-// void frame_destroy(void){
+// Returns the frame holding the read-only executable page at OFF in
+// INODE, with READ_BYTES of it read, after adding the pinned PAGE to
+// its pages, or null if no frame holds that page. The caller maps the
+// frame read-only.
+struct frame *frame_find_text(struct page *page, struct inode *inode,
+                              off_t off, size_t read_bytes){
+    ASSERT(page->pinned);
+    struct frame key;
+    key.inode = inode;
+    key.off = off;
+    key.read_bytes = read_bytes;
+    lock_acquire(&frame_table_lock);
+    struct hash_elem *e = hash_find(&text_frames, &key.text_elem);
+    struct frame *f = NULL;
+    if (e != NULL) {
+        f = hash_entry(e, struct frame, text_elem);
+        list_push_back(&f->pages, &page->frame_elem);
+    }
+    lock_release(&frame_table_lock);
+    return f;
+}
 
-// }
\ No newline at end of file
+// Records that F, whose page is pinned, now holds the read-only
+// executable page at OFF in INODE, with READ_BYTES of it read, for
+// frame_find_text. F is left private if another frame was filled with
+// the same page first.
+void frame_set_text(struct frame *f, struct inode *inode, off_t off,
+                    size_t read_bytes){
+    lock_acquire(&frame_table_lock);
+    ASSERT(frame_pinned(f) && f->inode == NULL);
+    f->inode = inode;
+    f->off = off;
+    f->read_bytes = read_bytes;
+    if (hash_insert(&text_frames, &f->text_elem) != NULL) {
+        f->inode = NULL;
+    }
+    lock_release(&frame_table_lock);
+}
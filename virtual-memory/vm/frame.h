@@ -4,8 +4,41 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+// User frame struct
+struct frame {
+    struct list_elem elem; // frame_table if in use, else free_frames
+    void *kpage; // frame
+    // Pages held in the frame, by frame_elem, or empty if free. More
+    // than one only while the pages share the frame read-only, as after
+    // fork; their number is the frame's reference count.
+    struct list pages;
+    // If INODE is set, the frame holds the read-only executable page at
+    // OFF in INODE, with READ_BYTES of it read, and is found by every
+    // process that loads the same page, through text_frames
+    struct hash_elem text_elem;
+    struct inode *inode;
+    off_t off;
+    size_t read_bytes;
+};
+
 void frame_init(void);
-void *frame_alloc(void *upage, bool writable);
-void frame_free(uint32_t * pd);
+struct frame *frame_alloc(struct page *page);
+struct frame *frame_try_alloc(struct page *page);
+void frame_pin(struct page *page);
+bool frame_try_pin(struct page *page);
+void frame_share(struct frame *f, struct page *page);
+struct frame *frame_unshare(struct page *page);
+struct frame *frame_find_text(struct page *page, struct inode *inode,
+                              off_t off, size_t read_bytes);
+void frame_set_text(struct frame *f, struct inode *inode, off_t off,
+                    size_t read_bytes);
+void frame_release(struct frame *f, struct page *page);
 
 #endif // VM_FRAME_H
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include "lib/kernel/hash.h"
 #include "lib/kernel/list.h"
+#include "filesys/file.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -22,46 +23,116 @@
 #include "vm/frame.h"
 
 
-typedef bool page_match_t (struct page *page, void *aux);
+// A file mapped with mmap, and the pages of the mapping, so that
+// page_unmap need not look at every page of the process.
+struct mapping {
+  struct hash_elem elem;
+  struct file *file;
+  struct list pages; // struct page, by file_elem
+  unsigned fault_around; // pages to bring in after a faulting one
+};
+
 static off_t file_size_in_page(struct page *page);
+static bool page_load(struct page *page);
+static bool page_map(struct page *page);
+static bool page_is_text(struct page *page);
+static bool page_find_text(struct page *page);
+static void fault_around(struct page *page);
+static struct page *swap_neighbor(struct page *page, int delta);
+static bool page_swap_in(struct page *page);
+static bool page_unshare(struct page *page);
+static void page_share(struct page *page, struct page *copy);
 static struct page *page_alloc(uint32_t *pd, void *upage,  bool writable);
 
-static struct page *find_page(page_match_t *match, void *aux);
-static page_match_t match_upage;
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_hash_func mapping_hash;
+static hash_less_func mapping_less;
+static hash_action_func page_destroy;
+static hash_action_func mapping_destroy;
 static struct page *find_upage(void *upage);
-static page_match_t match_file;
-static struct page *find_file(void *f);
+static struct mapping *find_mapping(struct file *f);
 static bool stack_growth(const void *uaddr, void *esp);
 
-static struct page *find_page(page_match_t *match, void *aux) {
-  struct list *sup_page_table = &thread_current()->sup_page_table;
-  for (struct list_elem *page_elem = list_begin(sup_page_table);
-       page_elem != list_end(sup_page_table);
-       page_elem = list_next(page_elem)) {
-    if (page_elem == NULL) {
-      break;
-    }
-    struct page *page_s = list_entry(page_elem, struct page, elem);
-    if (match(page_s, aux)) {
-      return page_s;
-    }
-  }
-  return NULL;
+static unsigned page_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct page *page = hash_entry(e, struct page, elem);
+  return hash_int((int)pg_no(page->upage));
 }
 
-static bool match_upage(struct page *page, void *upage) {
-  return page->upage == upage;
+static bool page_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                      void *aux UNUSED) {
+  const struct page *a = hash_entry(a_, struct page, elem);
+  const struct page *b = hash_entry(b_, struct page, elem);
+  return a->upage < b->upage;
 }
+
+static unsigned mapping_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct mapping *m = hash_entry(e, struct mapping, elem);
+  return hash_bytes(&m->file, sizeof m->file);
+}
+
+static bool mapping_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                         void *aux UNUSED) {
+  const struct mapping *a = hash_entry(a_, struct mapping, elem);
+  const struct mapping *b = hash_entry(b_, struct mapping, elem);
+  return a->file < b->file;
+}
+
 static struct page *find_upage(void *upage) {
-  return find_page(match_upage, upage);
+  struct page key;
+  key.upage = upage;
+  struct hash_elem *e = hash_find(&thread_current()->sup_page_table, &key.elem);
+  return e == NULL ? NULL : hash_entry(e, struct page, elem);
 }
 
-static bool match_file(struct page *page, void *file_) {
-  struct file *f = (struct file*)file_;
-  return page->file == f;
+static struct mapping *find_mapping(struct file *f) {
+  struct mapping key;
+  key.file = f;
+  struct hash_elem *e = hash_find(&thread_current()->mappings, &key.elem);
+  return e == NULL ? NULL : hash_entry(e, struct mapping, elem);
 }
-static struct page *find_file(void *f) {
-  return find_page(match_file, f);
+
+// Sets up the current process's supplemental page table, which is
+// keyed by user page so that a fault costs the same however large the
+// address space is.
+bool page_table_init(void) {
+  struct thread *t = thread_current();
+  if (!hash_init(&t->sup_page_table, page_hash, page_less, NULL)) {
+    return false;
+  }
+  if (!hash_init(&t->mappings, mapping_hash, mapping_less, NULL)) {
+    hash_destroy(&t->sup_page_table, NULL);
+    return false;
+  }
+  return true;
+}
+
+// Gives back exactly the frame and swap slot PAGE holds, so that exit
+// costs time in proportion to the process's own pages.
+static void page_destroy(struct hash_elem *e, void *aux UNUSED) {
+  struct page *page = hash_entry(e, struct page, elem);
+  frame_pin(page);
+  if (page->active) {
+    pagedir_clear_page(page->pd, page->upage);
+    frame_release(page->frame, page);
+  }
+  if (page->ss != SWAP_NONE) {
+    swap_free(page->ss);
+  }
+  free(page);
+}
+
+static void mapping_destroy(struct hash_elem *e, void *aux UNUSED) {
+  free(hash_entry(e, struct mapping, elem));
+}
+
+// Frees the current process's supplemental page table and everything
+// its pages hold. Mappings must have been written back with page_unmap
+// first, and the page directory must still exist.
+void page_table_destroy(void) {
+  struct thread *t = thread_current();
+  hash_destroy(&t->mappings, mapping_destroy);
+  hash_destroy(&t->sup_page_table, page_destroy);
 }
 
 static struct page *page_alloc(uint32_t *pd, void *upage,  bool writable) {
@@ -76,22 +147,25 @@ static struct page *page_alloc(uint32_t *pd, void *upage,  bool writable) {
   page_cur->pd = pd;
   page_cur->upage = upage;
   page_cur->active = false;
+  page_cur->pinned = false;
+  page_cur->evicting = false;
+  page_cur->dirty = false;
+  page_cur->frame = NULL;
   page_cur->file = NULL;
   page_cur->off = 0;
+  page_cur->read_bytes = 0;
+  page_cur->mapped = false;
   page_cur->writable = writable;
-  page_cur->ss = NULL;
-  list_push_back(&thread_current()->sup_page_table, &page_cur->elem);
+  page_cur->cow = false;
+  page_cur->ss = SWAP_NONE;
+  hash_insert(&thread_current()->sup_page_table, &page_cur->elem);
   return page_cur;
 }
 
-void page_set_frame(void *upage, void *kpage, bool writable) {
-  struct page *page_s = find_upage(upage);
-  if (page_s == NULL) {
-    page_s = page_alloc(thread_current()->pagedir, upage, writable);
-  }
-  ASSERT(page_s->writable == writable);
-  page_s->active = true;
-  page_s->frame = kpage;
+// Adds a zeroed, writable stack page at UPAGE and brings it in.
+bool page_add_stack(void *upage) {
+  struct page *page = page_alloc(thread_current()->pagedir, upage, true);
+  return page != NULL && page_load(page);
 }
 
 bool page_in_table(void *vaddr) {
@@ -99,37 +173,88 @@ bool page_in_table(void *vaddr) {
 }
 
 bool page_set_file(void *upage, struct file *f, off_t off) {
+  struct mapping *m = find_mapping(f);
+  if (m == NULL) {
+    m = malloc(sizeof *m);
+    if (m == NULL) {
+      return false;
+    }
+    m->file = f;
+    list_init(&m->pages);
+    m->fault_around = FAULT_AROUND_PAGES;
+    hash_insert(&thread_current()->mappings, &m->elem);
+  }
   struct page *page = page_alloc(thread_current()->pagedir, upage, true);
   if (page == NULL) {
     return false;
   }
   page->file = f;
   page->off = off;
-  // if(file_size_in_page(page) < PGSIZE){
-  //   memset(upage + off, 0, PGSIZE - file_size_in_page(page));
-  // }
+  page->mapped = true;
+  list_push_back(&m->pages, &page->file_elem);
+  return true;
+}
+
+// Records UPAGE as a page of an executable's segment, to be loaded on
+// first touch: READ_BYTES bytes from F at OFS, then zeros to the end of
+// the page. F may be null if READ_BYTES is 0.
+bool page_set_segment(void *upage, struct file *f, off_t off,
+                      size_t read_bytes, bool writable) {
+  ASSERT(read_bytes <= PGSIZE);
+  ASSERT(f != NULL || read_bytes == 0);
+  struct page *page = page_alloc(thread_current()->pagedir, upage, writable);
+  if (page == NULL) {
+    return false;
+  }
+  page->file = read_bytes > 0 ? f : NULL;
+  page->off = off;
+  page->read_bytes = read_bytes;
+  // Code another process has in memory costs nothing to map right away
+  page->pinned = true;
+  if (!page_find_text(page)) {
+    page->pinned = false;
+  }
   return true;
 }
 
 void page_remove(void *upage){
   struct page *page_s = find_upage(upage);
-  list_remove(&page_s->elem);
-  pagedir_clear_page(page_s->pd, upage);
+  frame_pin(page_s);
+  hash_delete(&thread_current()->sup_page_table, &page_s->elem);
+  if (page_s->mapped) {
+    list_remove(&page_s->file_elem);
+  }
+  if (page_s->active) {
+    pagedir_clear_page(page_s->pd, upage);
+    frame_release(page_s->frame, page_s);
+  }
+  if (page_s->ss != SWAP_NONE) {
+    swap_free(page_s->ss);
+  }
   free(page_s);
 }
 
 void page_unmap(struct file *f){
-  struct page *page_s = find_file(f);
+  struct mapping *m = find_mapping(f);
+  if (m == NULL) {
+    return;
+  }
 
-  while(page_s != NULL){
+  while(!list_empty(&m->pages)){
+    struct page *page_s =
+      list_entry(list_front(&m->pages), struct page, file_elem);
     void *upage = page_s->upage;
-    if(pagedir_is_dirty(page_s->pd, upage)){
+    // Pages not in memory were written back when they were evicted
+    frame_pin(page_s);
+    if(page_s->active
+       && (page_s->dirty || pagedir_is_dirty(page_s->pd, upage))){
       off_t size = file_size_in_page(page_s);
-      file_write_at(f, upage, size, page_s->off);
+      file_write_at(f, page_s->frame->kpage, size, page_s->off);
     }
     page_remove(upage);
-    page_s = find_file(f);
   }
+  hash_delete(&thread_current()->mappings, &m->elem);
+  free(m);
 }
 
 static off_t file_size_in_page(struct page *page) {
@@ -142,22 +267,299 @@ static off_t file_size_in_page(struct page *page) {
   }
 }
 
-bool page_write_data(void *upage){
-  struct page *page_s = find_upage(upage);
-  if (page_s == NULL) {
+// Fills the frame of PAGE with its contents: from swap if it was
+// swapped out, otherwise from its file, otherwise zeros. The frame is
+// written through its kernel address, so read-only pages can be loaded
+// too.
+static bool page_write_data(struct page *page_s){
+  bool success = true;
+  if(page_s->ss != SWAP_NONE){
+    success = swap_in(page_s->ss, page_s->frame->kpage);
+    page_s->ss = SWAP_NONE;
+    // The slot is gone, so the page must be written out again.
+    page_s->dirty = true;
+  } else if (page_s->file != NULL) {
+    off_t size = page_s->mapped ? file_size_in_page(page_s)
+                                : (off_t)page_s->read_bytes;
+    off_t bytes_read = file_read_at(page_s->file, page_s->frame->kpage, size,
+                                    page_s->off);
+    success = bytes_read == size;
+    memset((uint8_t *)page_s->frame->kpage + size, 0, PGSIZE - size);
+  } else {
+    memset(page_s->frame->kpage, 0, PGSIZE);
+  }
+  return success;
+}
+
+// Fills the pinned PAGE's new frame and maps it. Gives the frame back
+// on failure.
+static bool page_map(struct page *page) {
+  bool success = page_write_data(page)
+                 && pagedir_set_page(page->pd, page->upage, page->frame->kpage,
+                                     page->writable);
+  if (success) {
+    page->active = true;
+    if (page_is_text(page)) {
+      frame_set_text(page->frame, file_get_inode(page->file), page->off,
+                     page->read_bytes);
+    }
+  } else {
+    frame_release(page->frame, page);
+    page->frame = NULL;
+  }
+  page->pinned = false;
+  return success;
+}
+
+// Returns true if PAGE is read-only code or data of an executable, which
+// every process running the executable can share.
+static bool page_is_text(struct page *page) {
+  return !page->writable && !page->mapped && page->file != NULL;
+}
+
+// Maps the pinned PAGE, if it is text another process already has in a
+// frame, from that frame, and unpins it. Returns false, leaving PAGE
+// pinned and not in memory, otherwise. The executable cannot be written
+// while it runs, so the frame still holds what PAGE would load.
+static bool page_find_text(struct page *page) {
+  ASSERT(page->pinned && !page->active);
+  if (!page_is_text(page)) {
+    return false;
+  }
+  struct frame *f = frame_find_text(page, file_get_inode(page->file),
+                                    page->off, page->read_bytes);
+  if (f == NULL) {
+    return false;
+  }
+  if (!pagedir_set_page(page->pd, page->upage, f->kpage, false)) {
+    frame_release(f, page);
+    return false;
+  }
+  page->frame = f;
+  page->active = true;
+  page->pinned = false;
+  return true;
+}
+
+// Brings PAGE into a frame and maps it. PAGE is pinned meanwhile, so
+// that the clock does not pick its frame before it is filled.
+static bool page_load(struct page *page) {
+  ASSERT(!page->active);
+  page->pinned = true;
+  page->frame = frame_alloc(page);
+  return page_map(page);
+}
+
+// Sets how many pages after a faulting page of the mapping of F are
+// brought in with it, up to FAULT_AROUND_MAX. Returns false if F is
+// not mapped.
+bool page_set_fault_around(struct file *f, unsigned pages) {
+  struct mapping *m = find_mapping(f);
+  if (m == NULL) {
     return false;
   }
-  if (page_s->file != NULL) {
-    off_t size = file_size_in_page(page_s);
-    off_t bytes_read = file_read_at(page_s->file, upage, size, page_s->off);
-    pagedir_set_dirty(page_s->pd, upage, false);
-    return bytes_read == size;
-  } else if(page_s->ss != NULL){
-    bool success =  swap_in(page_s->ss, page_s->frame);
-    pagedir_set_dirty(page_s->pd, upage, false);
-    return success;
+  m->fault_around = pages < FAULT_AROUND_MAX ? pages : FAULT_AROUND_MAX;
+  return true;
+}
+
+// Brings in the pages that follow PAGE, just loaded from its file, as
+// long as they come from the same file, are not in memory or swap, and
+// a frame is free without evicting anything. They are mapped with the
+// accessed bit clear, so the clock takes them back first if they turn
+// out not to be needed. Sequential access through a mapping or an
+// executable then takes one fault per window instead of one per page.
+static void fault_around(struct page *page) {
+  unsigned window = FAULT_AROUND_PAGES;
+  if (page->mapped) {
+    window = find_mapping(page->file)->fault_around;
+  }
+  uint8_t *upage = page->upage;
+  for (unsigned i = 0; i < window; i++) {
+    upage += PGSIZE;
+    if (!is_user_vaddr(upage)) {
+      break;
+    }
+    struct page *next = find_upage(upage);
+    // A page the page-out thread is writing out is left alone; its
+    // fields only settle once the eviction is done.
+    if (next == NULL || !frame_try_pin(next)) {
+      break;
+    }
+    if (next->file != page->file || next->mapped != page->mapped
+        || next->active || next->ss != SWAP_NONE) {
+      next->pinned = false;
+      break;
+    }
+    if (page_find_text(next)) {
+      continue;
+    }
+    next->frame = frame_try_alloc(next);
+    if (next->frame == NULL) {
+      next->pinned = false;
+      break;
+    }
+    if (!page_map(next)) {
+      break;
+    }
+  }
+}
+
+// Returns the page DELTA pages away from PAGE, pinned and with a free
+// frame, if its slot is DELTA slots away from PAGE's in the same swap
+// cluster; otherwise returns null.
+static struct page *swap_neighbor(struct page *page, int delta) {
+  uintptr_t page_no = pg_no(page->upage);
+  if ((page_no + delta) / SWAP_CLUSTER_SLOTS
+      != page_no / SWAP_CLUSTER_SLOTS) {
+    return NULL;
+  }
+  struct page *n = find_upage((uint8_t *)page->upage + delta * PGSIZE);
+  // page_evict sets the slot before the eviction is done, so a neighbor
+  // still being written out must be turned away by the pin, not by the
+  // slot check.
+  if (n == NULL || !frame_try_pin(n)) {
+    return NULL;
+  }
+  if (n->active || n->ss == SWAP_NONE || n->ss != page->ss + delta) {
+    n->pinned = false;
+    return NULL;
+  }
+  n->frame = frame_try_alloc(n);
+  if (n->frame == NULL) {
+    n->pinned = false;
+    return NULL;
+  }
+  return n;
+}
+
+// Brings the swapped-out PAGE back, with read-ahead: the neighbors of
+// PAGE in its virtual cluster whose slots lie next to its own, which
+// swap_out arranges, come back in the same sequential read, as long as
+// frames are free. They are mapped with the accessed bit clear. After a
+// burst of evictions, a process that touches its pages again then takes
+// one fault per cluster instead of one per page.
+static bool page_swap_in(struct page *page) {
+  ASSERT(!page->active && page->ss != SWAP_NONE);
+  page->pinned = true;
+  page->frame = frame_alloc(page);
+
+  // RUN is in slot order, with PAGE at index FIRST
+  struct page *run[2 * SWAP_CLUSTER_SLOTS];
+  size_t first = SWAP_CLUSTER_SLOTS, end = first + 1;
+  run[first] = page;
+  struct page *n;
+  while ((n = swap_neighbor(page, (int)first - SWAP_CLUSTER_SLOTS - 1))
+         != NULL) {
+    run[--first] = n;
+  }
+  while ((n = swap_neighbor(page, (int)end - SWAP_CLUSTER_SLOTS)) != NULL) {
+    run[end++] = n;
+  }
+
+  void *kpages[2 * SWAP_CLUSTER_SLOTS];
+  for (size_t i = first; i < end; i++) {
+    kpages[i] = run[i]->frame->kpage;
+  }
+  swap_in_range(run[first]->ss, end - first, kpages + first);
+
+  // The run shares PAGE's page table, so if PAGE can be mapped so can the
+  // others.
+  bool success = pagedir_set_page(page->pd, page->upage, page->frame->kpage,
+                                  page->writable);
+  for (size_t i = first; i < end; i++) {
+    struct page *p = run[i];
+    p->ss = SWAP_NONE;
+    // The slot is gone, so the page must be written out again.
+    p->dirty = true;
+    if (success && (p == page || pagedir_set_page(p->pd, p->upage,
+                                                  p->frame->kpage,
+                                                  p->writable))) {
+      p->active = true;
+    } else {
+      frame_release(p->frame, p);
+      p->frame = NULL;
+    }
+    p->pinned = false;
+  }
+  return success;
+}
+
+// Gives the pinned, copy-on-write PAGE, which is being written, a frame
+// of its own and maps it writable. The last page left in a shared frame
+// just takes it over, without a copy.
+static bool page_unshare(struct page *page) {
+  ASSERT(page->active && page->cow);
+  struct frame *f = frame_unshare(page);
+  pagedir_clear_page(page->pd, page->upage);
+  page->frame = f;
+  page->cow = false;
+  bool success = pagedir_set_page(page->pd, page->upage, f->kpage, true);
+  page->pinned = false;
+  return success;
+}
+
+// Writes PAGE out, if it must be, and takes it out of its frame, so
+// that the frame can be reused. Called by the frame table for the
+// victim of an eviction, which it has marked as being evicted:
+//
+//   - A mapped page that was written goes back to its file.
+//   - A page that matches what page_write_data would load again, such
+//     as code, untouched data or a zero page, is simply dropped.
+//   - Any other page goes to swap.
+void page_evict(struct page *page) {
+  ASSERT(page->active && page->evicting);
+  // Unmap first, so that writes from now on fault instead of being lost
+  pagedir_clear_page(page->pd, page->upage);
+  page->dirty = page->dirty || pagedir_is_dirty(page->pd, page->upage);
+  if (page->mapped) {
+    if (page->dirty) {
+      file_write_at(page->file, page->frame->kpage, file_size_in_page(page),
+                    page->off);
+      page->dirty = false;
+    }
+  } else if (page->dirty) {
+    page->ss = swap_out(page->frame->kpage, page->pd, page->upage);
+    if (page->ss == SWAP_NONE) {
+      PANIC("swap is full");
+    }
+  }
+  page->active = false;
+  page->cow = false;
+  page->frame = NULL;
+}
+
+// Writes out the pages sharing frame F, the victim of an eviction, like
+// page_evict. They all hold the same contents, so if any of them must be
+// written, the frame goes to swap once and every page holds the slot,
+// reading its own copy back in when it next faults.
+void page_evict_shared(struct frame *f) {
+  bool dirty = false;
+  for (struct list_elem *e = list_begin(&f->pages); e != list_end(&f->pages);
+       e = list_next(e)) {
+    struct page *page = list_entry(e, struct page, frame_elem);
+    ASSERT(page->active && page->evicting && !page->mapped);
+    pagedir_clear_page(page->pd, page->upage);
+    dirty = dirty || page->dirty || pagedir_is_dirty(page->pd, page->upage);
+  }
+  swap_slot_t slot = SWAP_NONE;
+  if (dirty) {
+    struct page *first = list_entry(list_front(&f->pages), struct page,
+                                    frame_elem);
+    slot = swap_out(f->kpage, first->pd, first->upage);
+    if (slot == SWAP_NONE) {
+      PANIC("swap is full");
+    }
+    swap_share(slot, list_size(&f->pages) - 1);
+  }
+  for (struct list_elem *e = list_begin(&f->pages); e != list_end(&f->pages);
+       e = list_next(e)) {
+    struct page *page = list_entry(e, struct page, frame_elem);
+    page->ss = slot;
+    page->dirty = false;
+    page->active = false;
+    page->cow = false;
+    page->frame = NULL;
   }
-  return false;
 }
 
 bool page_is_writable(void *upage){
@@ -166,11 +568,13 @@ bool page_is_writable(void *upage){
   return page_s->writable;
 }
 
-bool page_set_swap(void *upage, struct swap_slot *ss){
+// Returns true if UPAGE is writable but mapped read-only, sharing its
+// frame since fork, so that the first write to it must go through
+// page_fetch.
+bool page_is_cow(void *upage){
   struct page *page_s = find_upage(upage);
-  page_s->ss = ss;
-  page_s->active = false;
-  return true;
+  ASSERT(page_s != NULL);
+  return page_s->cow;
 }
 
 static bool stack_growth(const void *uaddr, void *esp) {
@@ -191,19 +595,121 @@ bool page_fetch(const void *uaddr, void* esp, bool write) {
     } else if (stack_growth(uaddr, esp)) {
       // Need to grow the stack
       // TODO: limit stack growth
-      void *kpage = frame_alloc(page, true);
-      page_set_frame(page, kpage, true);
-      return true;
+      return page_add_stack(page);
     } else {
       return false;
     }
   } else if (write && !page_is_writable(page)) {
     return false;
   } else {
-    // Need to swap a page
-    void *kpage = frame_alloc(page, true);
-    page_set_frame(page, kpage, true);
-    page_write_data(page);
+    // Bring the page in from swap, its file or nothing
+    struct page *page_s = find_upage(page);
+    frame_pin(page_s);
+    if (page_s->active) {
+      if (write && page_s->cow) {
+        return page_unshare(page_s);
+      }
+      page_s->pinned = false;
+      return true;
+    }
+    if (page_s->ss != SWAP_NONE) {
+      return page_swap_in(page_s);
+    }
+    if (!page_find_text(page_s) && !page_load(page_s)) {
+      return false;
+    }
+    if (page_s->file != NULL) {
+      fault_around(page_s);
+    }
     return true;
   }
-}
\ No newline at end of file
+}
+// Makes COPY, a page of the current process, share the frame of PAGE,
+// which is pinned and in memory. Both are mapped read-only; if they are
+// writable, each gets its own copy on its first write.
+static void page_share(struct page *page, struct page *copy) {
+  ASSERT(page->active && page->pinned);
+  page->dirty = page->dirty || pagedir_is_dirty(page->pd, page->upage);
+  if (page->writable) {
+    pagedir_clear_page(page->pd, page->upage);
+    pagedir_set_page(page->pd, page->upage, page->frame->kpage, false);
+    page->cow = true;
+  }
+  if (!pagedir_set_page(copy->pd, copy->upage, page->frame->kpage, false)) {
+    return;
+  }
+  copy->frame = page->frame;
+  copy->dirty = page->dirty;
+  copy->cow = page->cow;
+  copy->active = true;
+  frame_share(page->frame, copy);
+}
+
+// Copies the pages of PARENT, which is blocked in fork, into the current
+// process, apart from mapped files, which page_fork_mapping copies. No
+// page is copied yet: pages in memory share their frames copy-on-write,
+// swapped-out pages share their slots, and pages not yet loaded are
+// recorded as they are, to be loaded from the current process's own
+// executable. Returns false if memory runs out.
+bool page_fork(struct thread *parent) {
+  struct thread *t = thread_current();
+  struct hash_iterator i;
+  hash_first(&i, &parent->sup_page_table);
+  while (hash_next(&i)) {
+    struct page *page = hash_entry(hash_cur(&i), struct page, elem);
+    if (page->mapped) {
+      continue;
+    }
+    struct page *copy = page_alloc(t->pagedir, page->upage, page->writable);
+    if (copy == NULL) {
+      return false;
+    }
+    copy->file = page->file != NULL ? t->executing : NULL;
+    copy->off = page->off;
+    copy->read_bytes = page->read_bytes;
+
+    frame_pin(page);
+    if (page->active) {
+      page_share(page, copy);
+    } else if (page->ss != SWAP_NONE) {
+      swap_share(page->ss, 1);
+      copy->ss = page->ss;
+    }
+    page->pinned = false;
+    if (page->active && !copy->active) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Maps F, the current process's copy of PARENT_FILE, where PARENT has it
+// mapped. PARENT's changes are written back first, so that the current
+// process reads them from F; from then on the two mappings are separate.
+bool page_fork_mapping(struct thread *parent, struct file *parent_file,
+                       struct file *f) {
+  struct mapping key;
+  key.file = parent_file;
+  struct hash_elem *e = hash_find(&parent->mappings, &key.elem);
+  if (e == NULL) {
+    return false;
+  }
+  struct mapping *m = hash_entry(e, struct mapping, elem);
+  for (struct list_elem *pe = list_begin(&m->pages); pe != list_end(&m->pages);
+       pe = list_next(pe)) {
+    struct page *page = list_entry(pe, struct page, file_elem);
+    frame_pin(page);
+    if (page->active
+        && (page->dirty || pagedir_is_dirty(page->pd, page->upage))) {
+      file_write_at(parent_file, page->frame->kpage, file_size_in_page(page),
+                    page->off);
+      page->dirty = false;
+      pagedir_set_dirty(page->pd, page->upage, false);
+    }
+    page->pinned = false;
+    if (!page_set_file(page->upage, f, page->off)) {
+      return false;
+    }
+  }
+  return page_set_fault_around(f, m->fault_around);
+}
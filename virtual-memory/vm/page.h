@@ -5,31 +5,61 @@
 #include <debug.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "lib/kernel/hash.h"
 #include "lib/kernel/list.h"
 #include "filesys/off_t.h"
+#include "vm/swap.h"
+
+// Pages brought in after a faulting file-backed page, unless a mapping
+// asks for another number
+#define FAULT_AROUND_PAGES 4
+#define FAULT_AROUND_MAX 16
 
 // User page struct
 struct page {
-  struct list_elem elem;
+  struct hash_elem elem; // thread_current()->sup_page_table
+  struct list_elem file_elem; // struct mapping's pages, if file is set
   uint32_t *pd; // looking at thread_current()
-  void *frame; // frame
+  struct frame *frame; // frame holding the page, if ACTIVE
+  struct list_elem frame_elem; // struct frame's pages, if ACTIVE
   void *upage; // user page (starting address of the page)
   bool active; // True if in the frame table
-  struct file *file;
-  off_t off;
+  bool pinned; // True while being loaded or freed, so not to be evicted
+  bool evicting; // True while being written out by the frame table
+  bool dirty; // True if FRAME differs from FILE or zeros, apart from the
+              // dirty bit in PD
+  struct file *file; // File to load from, or null
+  off_t off; // Offset of the page in FILE
+  size_t read_bytes; // Bytes to read from FILE, unless MAPPED
+  bool mapped; // True if mapped with mmap, so FILE is written back
   bool writable;
-  struct swap_slot *ss;
+  bool cow; // True if WRITABLE but FRAME was shared by fork, so it is
+            // mapped read-only until the first write copies it
+  swap_slot_t ss; // Swap slot holding the page, or SWAP_NONE
 };
 
+struct frame;
+struct thread;
+
 void page_init(void);
-void page_set_frame(void *upage, void *kpage, bool writable);
+bool page_table_init(void);
+void page_table_destroy(void);
+bool page_add_stack(void *upage);
 bool page_set_file(void *upage, struct file *f, off_t ofs);
+bool page_set_fault_around(struct file *f, unsigned pages);
+bool page_set_segment(void *upage, struct file *f, off_t ofs,
+                      size_t read_bytes, bool writable);
 bool page_in_table(void *vaddr);
 void page_remove(void *upage);
 void page_unmap(struct file *f);
-bool page_write_data(void *upage);
 bool page_is_writable(void *upage);
-bool page_set_swap(void *upage, struct swap_slot *ss);
+bool page_is_cow(void *upage);
+void page_evict(struct page *page);
+void page_evict_shared(struct frame *f);
 bool page_fetch(const void *uaddr, void* esp, bool write);
+bool page_fork(struct thread *parent);
+bool page_fork_mapping(struct thread *parent, struct file *parent_file,
+                       struct file *f);
 
 #endif // VM_PAGE_H
\ No newline at end of file
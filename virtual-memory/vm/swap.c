@@ -1,5 +1,6 @@
 #include "vm/swap.h"
 
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
@@ -9,77 +10,194 @@
 
 #include "devices/block.h"
 #include "lib/kernel/hash.h"
-#include "lib/kernel/list.h"
-#include "threads/flags.h"
-#include "threads/init.h"
-#include "threads/interrupt.h"
 #include "threads/malloc.h"
-#include "threads/palloc.h"
 #include "threads/synch.h"
-#include "threads/thread.h"
 #include "threads/vaddr.h"
-#include "userprog/pagedir.h"
 
-// global list
-static block_sector_t next_sector;
+// A run of SWAP_CLUSTER_SLOTS slots set aside for the virtual pages
+// of one process that share a cluster number. Page N of the run goes
+// to slot N of the cluster.
+struct swap_cluster {
+  struct hash_elem elem;
+  const uint32_t *pd; // page directory of the owning process
+  uintptr_t vcluster; // virtual page number / SWAP_CLUSTER_SLOTS
+  size_t index;       // cluster number in the partition
+};
 
 static struct block *swap_block;
 
-static struct list swap_occupied;
-static struct list swap_unoccupied;
-static struct lock swap_table_lock;
+static struct bitmap *swap_map;         // one bit per slot, set if used
+static struct swap_cluster **clusters;  // by cluster number, null if free
+static unsigned *slot_shares;           // by slot, pages holding it besides
+                                        // the first one
+static size_t cluster_cnt;
+static size_t next_cluster;             // where to look for a free cluster
+static struct hash cluster_table;       // bound clusters, by owner
+static struct lock swap_table_lock;     // protects all of the above
 
-static struct swap_slot *get_slot(void);
+static hash_hash_func cluster_hash;
+static hash_less_func cluster_less;
+static swap_slot_t get_slot(const uint32_t *pd, const void *upage);
+static void put_slot(swap_slot_t slot);
 
-static struct swap_slot *get_slot(void) {
-  struct swap_slot *ss;
-  if (list_empty(&swap_unoccupied)) {
-    if (next_sector >= block_size(swap_block)) {
-      return NULL;
+static unsigned cluster_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct swap_cluster *c = hash_entry(e, struct swap_cluster, elem);
+  return hash_bytes(&c->pd, sizeof c->pd) ^ hash_int((int)c->vcluster);
+}
+
+static bool cluster_less(const struct hash_elem *a_,
+                         const struct hash_elem *b_, void *aux UNUSED) {
+  const struct swap_cluster *a = hash_entry(a_, struct swap_cluster, elem);
+  const struct swap_cluster *b = hash_entry(b_, struct swap_cluster, elem);
+  if (a->pd != b->pd) {
+    return a->pd < b->pd;
+  }
+  return a->vcluster < b->vcluster;
+}
+
+// Picks a free slot for UPAGE of the process with page directory PD:
+// its place in the cluster bound to its neighbors if there is one,
+// else its place in a newly bound free cluster, else any free slot.
+static swap_slot_t get_slot(const uint32_t *pd, const void *upage) {
+  ASSERT(lock_held_by_current_thread(&swap_table_lock));
+  size_t page_no = pg_no(upage);
+  struct swap_cluster key;
+  key.pd = pd;
+  key.vcluster = page_no / SWAP_CLUSTER_SLOTS;
+  size_t ofs = page_no % SWAP_CLUSTER_SLOTS;
+
+  struct hash_elem *e = hash_find(&cluster_table, &key.elem);
+  if (e != NULL) {
+    struct swap_cluster *c = hash_entry(e, struct swap_cluster, elem);
+    swap_slot_t slot = c->index * SWAP_CLUSTER_SLOTS + ofs;
+    if (!bitmap_test(swap_map, slot)) {
+      bitmap_mark(swap_map, slot);
+      return slot;
     }
-    ss = malloc(sizeof(struct swap_slot));
-    lock_acquire(&swap_table_lock);
-    ss->first_sector = next_sector;
-    next_sector += SWAP_SLOT_NUM_SECTORS;
-    list_push_back(&swap_occupied, &ss->elem);
-    lock_release(&swap_table_lock);
   } else {
-    lock_acquire(&swap_table_lock);
-    ss = list_entry(list_pop_front(&swap_unoccupied), struct swap_slot, elem);
-    list_push_back(&swap_occupied, &ss->elem);
-    lock_release(&swap_table_lock);
+    for (size_t i = 0; i < cluster_cnt; i++) {
+      size_t index = (next_cluster + i) % cluster_cnt;
+      if (clusters[index] == NULL
+          && bitmap_none(swap_map, index * SWAP_CLUSTER_SLOTS,
+                         SWAP_CLUSTER_SLOTS)) {
+        struct swap_cluster *c = malloc(sizeof *c);
+        if (c == NULL) {
+          break;
+        }
+        *c = key;
+        c->index = index;
+        clusters[index] = c;
+        hash_insert(&cluster_table, &c->elem);
+        next_cluster = (index + 1) % cluster_cnt;
+        swap_slot_t slot = index * SWAP_CLUSTER_SLOTS + ofs;
+        bitmap_mark(swap_map, slot);
+        return slot;
+      }
+    }
+  }
+
+  // Swap is too full or too fragmented to keep neighbors together
+  return bitmap_scan_and_flip(swap_map, 0, 1, false);
+}
+
+// Drops a page's hold on SLOT. Frees SLOT once no page holds it, and
+// its cluster if that is now empty.
+static void put_slot(swap_slot_t slot) {
+  ASSERT(lock_held_by_current_thread(&swap_table_lock));
+  ASSERT(bitmap_test(swap_map, slot));
+  if (slot_shares[slot] > 0) {
+    slot_shares[slot]--;
+    return;
+  }
+  bitmap_reset(swap_map, slot);
+  size_t index = slot / SWAP_CLUSTER_SLOTS;
+  struct swap_cluster *c = clusters[index];
+  if (c != NULL
+      && bitmap_none(swap_map, index * SWAP_CLUSTER_SLOTS,
+                     SWAP_CLUSTER_SLOTS)) {
+    hash_delete(&cluster_table, &c->elem);
+    clusters[index] = NULL;
+    free(c);
   }
-  return ss;
 }
 
 void swap_init(void) {
-  list_init(&swap_occupied);
-  list_init(&swap_unoccupied);
   lock_init(&swap_table_lock);
+  hash_init(&cluster_table, cluster_hash, cluster_less, NULL);
   swap_block = block_get_role(BLOCK_SWAP);
-  next_sector = 0;
+  size_t slot_cnt = 0;
+  if (swap_block != NULL) {
+    slot_cnt = block_size(swap_block) / SWAP_SLOT_NUM_SECTORS;
+  }
+  // Whole clusters only; a partial one at the end is not used.
+  cluster_cnt = slot_cnt / SWAP_CLUSTER_SLOTS;
+  swap_map = bitmap_create(cluster_cnt * SWAP_CLUSTER_SLOTS);
+  clusters = calloc(cluster_cnt + 1, sizeof *clusters);
+  slot_shares = calloc(cluster_cnt * SWAP_CLUSTER_SLOTS + 1,
+                       sizeof *slot_shares);
+  if (swap_map == NULL || clusters == NULL || slot_shares == NULL) {
+    PANIC("swap: out of memory");
+  }
+  next_cluster = 0;
 }
 
-// put back into memory using block_read
-bool swap_in(struct swap_slot *ss, void *kpage) {
-  for (uint32_t i = 0; i < SWAP_SLOT_NUM_SECTORS; i++) {
-    block_read(swap_block, ss->first_sector + i,
-               (char *)kpage + i * BLOCK_SECTOR_SIZE);
+// Reads the CNT slots starting at FIRST into the pages in KPAGES, in
+// one run of sectors, and gives them back as swap_free does.
+void swap_in_range(swap_slot_t first, size_t cnt, void **kpages) {
+  for (size_t i = 0; i < cnt; i++) {
+    block_sector_t sector = (first + i) * SWAP_SLOT_NUM_SECTORS;
+    for (uint32_t j = 0; j < SWAP_SLOT_NUM_SECTORS; j++) {
+      block_read(swap_block, sector + j,
+                 (char *)kpages[i] + j * BLOCK_SECTOR_SIZE);
+    }
   }
+  swap_free_range(first, cnt);
+}
+
+// put back into memory using block_read, and free the slot
+bool swap_in(swap_slot_t slot, void *kpage) {
+  swap_in_range(slot, 1, &kpage);
+  return true;
+}
+
+// give back a slot whose contents are no longer needed
+void swap_free(swap_slot_t slot) {
+  swap_free_range(slot, 1);
+}
+
+void swap_free_range(swap_slot_t first, size_t cnt) {
   lock_acquire(&swap_table_lock);
-  list_remove(&ss->elem);
-  list_push_back(&swap_unoccupied, &ss->elem);
+  for (size_t i = 0; i < cnt; i++) {
+    put_slot(first + i);
+  }
   lock_release(&swap_table_lock);
-  return true;
 }
 
-// put into swap_block using block_write
-struct swap_slot *swap_out(void *kpage) {
-  struct swap_slot *ss = get_slot();
+// put into swap_block using block_write, next to the slots of the
+// neighbors of UPAGE in the process with page directory PD if
+// possible. Returns SWAP_NONE if swap is full.
+swap_slot_t swap_out(void *kpage, const uint32_t *pd, const void *upage) {
+  lock_acquire(&swap_table_lock);
+  swap_slot_t slot = get_slot(pd, upage);
+  lock_release(&swap_table_lock);
+  if (slot == BITMAP_ERROR) {
+    return SWAP_NONE;
+  }
+  block_sector_t sector = slot * SWAP_SLOT_NUM_SECTORS;
   for (uint32_t i = 0; i < SWAP_SLOT_NUM_SECTORS; i++) {
-    block_write(swap_block, ss->first_sector + i,
+    block_write(swap_block, sector + i,
                 (char *)kpage + i * BLOCK_SECTOR_SIZE);
   }
+  return slot;
+}
 
-  return ss;
-}
\ No newline at end of file
+
+// Lets CNT more pages hold SLOT, each of which gives it back with
+// swap_in or swap_free. Pages that shared a frame copy-on-write share
+// its slot in the same way, and each reads its own copy back in.
+void swap_share(swap_slot_t slot, size_t cnt) {
+  lock_acquire(&swap_table_lock);
+  ASSERT(bitmap_test(swap_map, slot));
+  slot_shares[slot] += cnt;
+  lock_release(&swap_table_lock);
+}
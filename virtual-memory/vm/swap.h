@@ -1,18 +1,29 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "devices/block.h"
-#include "lib/kernel/list.h"
 #include "threads/vaddr.h"
 
 #define SWAP_SLOT_NUM_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
-struct swap_slot {
-    struct list_elem elem;
-    block_sector_t first_sector;
-};
+// Slots in a cluster: a run of slots set aside for a run of virtual
+// pages of one process, so that neighbors in memory are neighbors on
+// disk.
+#define SWAP_CLUSTER_SLOTS 8
+
+// Index of a page-sized slot in the swap partition
+typedef size_t swap_slot_t;
+#define SWAP_NONE ((swap_slot_t) -1)
+
 void swap_init(void);
-bool swap_in(struct swap_slot *ss, void *kpage);
-struct swap_slot *swap_out(void *kpage);
+swap_slot_t swap_out(void *kpage, const uint32_t *pd, const void *upage);
+void swap_share(swap_slot_t slot, size_t cnt);
+bool swap_in(swap_slot_t slot, void *kpage);
+void swap_in_range(swap_slot_t first, size_t cnt, void **kpages);
+void swap_free(swap_slot_t slot);
+void swap_free_range(swap_slot_t first, size_t cnt);
 
-#endif // VM_SWAP_H
\ No newline at end of file
+#endif // VM_SWAP_H